@@ -0,0 +1,172 @@
+/**
+***	clock.c: TSC based monotonic and realtime clocks.
+**/
+
+#include "clock.h"
+#include "lib.h"
+#include "pit.h"
+#include "rtc.h"
+#include "timer.h"
+
+static uint32_t tsc_khz = 0;
+static uint32_t tsc_mult = 0;
+static uint64_t tsc_boot = 0;
+
+/* The CMOS time and the monotonic time it was read at */
+static uint32_t boot_time = 0;
+static uint64_t boot_time_ns = 0;
+
+/* Reached through the kernel direct map, mapped for programs by paging.c */
+time_page_t* time_page = NULL;
+
+/* 
+ * clock_init
+ * Sets up the clocks
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Measures the TSC against the PIT and precomputes the
+ *			cycles to ns multiplier, so reading the clock needs no
+ *			division. Without a usable TSC the clock counts timer
+ *			ticks instead. The CMOS is read once, after that the
+ *			realtime clock is the monotonic clock plus that offset.
+ */
+void clock_init(void)
+{
+	tsc_khz = pit_calibrate_tsc();
+	if (tsc_khz < TSC_MIN_KHZ)
+	{
+		tsc_khz = 0;
+	}
+	else
+	{
+		tsc_mult = div64_32((uint64_t)NSEC_PER_MSEC << CLOCK_SHIFT, tsc_khz, NULL);
+	}
+	tsc_boot = rdtsc();
+
+	boot_time = rtc_get_time();
+	boot_time_ns = clock_ns();
+
+	if (time_page == NULL)
+	{
+		return;
+	}
+	time_page->seq++;
+	barrier();
+	time_page->ticks = timer_ticks;
+	time_page->timer_hz = TIMER_HZ;
+	time_page->tsc_khz = tsc_khz;
+	time_page->tsc_mult = tsc_mult;
+	time_page->tsc_shift = CLOCK_SHIFT;
+	time_page->tsc_boot = tsc_boot;
+	time_page->boot_time = boot_time;
+	time_page->boot_time_ns = boot_time_ns;
+	barrier();
+	time_page->seq++;
+}
+
+/* 
+ * clock_tick
+ * Updates the time page
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Called by the PIT after timer_tick. seq is odd while the
+ *			tick count changes, so a program that reads the page mid
+ *			update sees it and reads again.
+ */
+void clock_tick(void)
+{
+	if (time_page == NULL)
+	{
+		return;
+	}
+	time_page->seq++;
+	barrier();
+	time_page->ticks = timer_ticks;
+	barrier();
+	time_page->seq++;
+}
+
+/* 
+ * clock_ns
+ * Reads the monotonic clock
+ * INPUTS: none
+ * OUTPUTS: nanoseconds since clock_init
+ * EFFECTS: none
+ */
+uint64_t clock_ns(void)
+{
+	if (tsc_khz == 0)
+	{
+		return (uint64_t)timer_ticks * (MS_PER_TICK * NSEC_PER_MSEC);
+	}
+	return clock_tsc_to_ns(rdtsc());
+}
+
+/* 
+ * clock_tsc_to_ns
+ * Converts a TSC reading taken earlier
+ * INPUTS: tsc - rdtsc value
+ * OUTPUTS: nanoseconds from clock_init to that reading, 0 for readings
+ *			before it or when the TSC is not used
+ * EFFECTS: The cycle count is split in halves so both products fit
+ *			in 64 bits, good for centuries of uptime.
+ */
+uint64_t clock_tsc_to_ns(uint64_t tsc)
+{
+	uint64_t cycles;
+	uint32_t lo, hi;
+
+	if (tsc_khz == 0 || tsc < tsc_boot)
+	{
+		return 0;
+	}
+
+	cycles = tsc - tsc_boot;
+	lo = (uint32_t)cycles;
+	hi = (uint32_t)(cycles >> 32);
+	return (((uint64_t)lo * tsc_mult) >> CLOCK_SHIFT)
+		+ (((uint64_t)hi * tsc_mult) << (32 - CLOCK_SHIFT));
+}
+
+/* 
+ * clock_tsc_khz
+ * Reports the calibrated TSC frequency
+ * INPUTS: none
+ * OUTPUTS: kHz, 0 if the TSC is not used
+ * EFFECTS: none
+ */
+uint32_t clock_tsc_khz(void)
+{
+	return tsc_khz;
+}
+
+/* 
+ * clock_read
+ * Reads a clock into a timespec
+ * INPUTS: clock_id - CLOCK_REALTIME or CLOCK_MONOTONIC
+ *		   tp - where the time goes
+ * OUTPUTS: 0 on success, -1 on a bad clock id
+ * EFFECTS: none
+ */
+int32_t clock_read(int32_t clock_id, timespec_t* tp)
+{
+	uint64_t ns = clock_ns();
+	uint32_t base = 0;
+	uint32_t nsec;
+
+	switch (clock_id)
+	{
+		case CLOCK_MONOTONIC:
+			break;
+		case CLOCK_REALTIME:
+			ns -= boot_time_ns;
+			base = boot_time;
+			break;
+		default:
+			return -1;
+	}
+
+	tp->tv_sec = base + div64_32(ns, NSEC_PER_SEC, &nsec);
+	tp->tv_nsec = nsec;
+	return 0;
+}
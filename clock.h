@@ -0,0 +1,63 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+
+/* clock_gettime clock ids */
+#define CLOCK_REALTIME		0
+#define CLOCK_MONOTONIC		1
+
+#define NSEC_PER_SEC		1000000000
+#define NSEC_PER_MSEC		1000000
+
+/* cycles to ns is (cycles * tsc_mult) >> CLOCK_SHIFT */
+#define CLOCK_SHIFT			24
+#define TSC_MIN_KHZ			4000	// below this tsc_mult would not fit in 32 bits
+
+typedef struct timespec {
+	int32_t tv_sec;
+	int32_t tv_nsec;
+} timespec_t;
+
+/* Read-only page every program sees at TIME_PAGE, so it can tell the
+ * time without a syscall. To read it: load seq, retry while it is odd,
+ * copy the fields, and retry if seq changed meanwhile. The monotonic
+ * clock in ns is then computed like clock_ns: split rdtsc() - tsc_boot
+ * into 32 bit halves lo and hi, and add (lo * tsc_mult) >> tsc_shift
+ * and (hi * tsc_mult) << (32 - tsc_shift). Realtime is boot_time
+ * seconds plus the ns elapsed since boot_time_ns. When tsc_khz is 0,
+ * use ticks / timer_hz instead. */
+typedef struct time_page {
+	volatile uint32_t seq;			// odd while the kernel is writing
+	uint32_t ticks;					// timer_ticks, updated every tick
+	uint32_t timer_hz;
+	uint32_t tsc_khz;				// 0 if the clock runs on ticks
+	uint32_t tsc_mult;
+	uint32_t tsc_shift;
+	uint64_t tsc_boot;				// rdtsc() at monotonic time 0
+	uint32_t boot_time;				// CMOS time, seconds since 1970
+	uint64_t boot_time_ns;			// monotonic time boot_time was read at
+} time_page_t;
+
+/* Kernel side of the time page, NULL if no frame was left for it */
+extern time_page_t* time_page;
+
+/* Calibrates the TSC and reads the wall clock, call with interrupts off */
+void clock_init(void);
+
+/* Called on every PIT tick, publishes the tick count to the time page */
+void clock_tick(void);
+
+/* Nanoseconds since clock_init */
+uint64_t clock_ns(void);
+
+/* Nanoseconds from clock_init to an earlier rdtsc value */
+uint64_t clock_tsc_to_ns(uint64_t tsc);
+
+/* TSC frequency in kHz, 0 if the clock falls back to timer ticks */
+uint32_t clock_tsc_khz(void);
+
+/* Fills tp with the time on the given clock, -1 on a bad clock id */
+int32_t clock_read(int32_t clock_id, timespec_t* tp);
+
+#endif
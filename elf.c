@@ -0,0 +1,172 @@
+/**
+***	elf.c: ELF32 executable parsing for execute.
+**/
+
+#include "elf.h"
+#include "filesys.h"
+#include "lib.h"
+#include "paging.h"
+
+/* Parsed executables. A slot is picked by inode modulo the cache size
+	and tagged with the full inode, so two inodes sharing a slot just
+	evict each other. The filesystem is read-only, so an entry never has
+	to be invalidated. Callers get a copy, never a pointer into here. */
+static elf_image_t elf_cache[ELF_CACHE_SIZE];
+
+/*
+ *	int32_t elf_add_segment(elf_image_t* image, uint32_t vaddr, uint32_t offset, uint32_t filesz, uint32_t memsz, uint32_t length);
+ *  	Inputs: image - image being built
+ *				vaddr, offset, filesz, memsz - segment from the program header
+ *				length - length of the file
+ *  	Return Value: 0 on success, -1 if the segment can't be loaded
+ *		Function: Checks that a segment lies in the file and in the
+ *				  program page, then adds it to the image.
+ */
+static int32_t elf_add_segment(elf_image_t* image, uint32_t vaddr, uint32_t offset, uint32_t filesz, uint32_t memsz, uint32_t length)
+{
+	if (image->num_segments >= ELF_MAX_SEGMENTS)
+	{
+		return -1;
+	}
+	if (filesz > memsz || offset > length || filesz > length - offset)
+	{
+		return -1;
+	}
+	if (vaddr < _128MB || vaddr >= _128MB + _4MB || memsz > _128MB + _4MB - vaddr)
+	{
+		return -1;
+	}
+
+	image->segment[image->num_segments].vaddr = vaddr;
+	image->segment[image->num_segments].offset = offset;
+	image->segment[image->num_segments].filesz = filesz;
+	image->segment[image->num_segments].memsz = memsz;
+	image->num_segments++;
+	return 0;
+}
+
+/*
+ *	int32_t elf_load(uint32_t inode, elf_image_t* image);
+ *  	Inputs: inode - inode of the executable
+ *				image - where the parsed executable is copied
+ *  	Return Value: 0 on success, -1 if the file isn't a loadable executable
+ *		Function: Reads the ELF header and program headers once, keeps the
+ *				  entry point and the PT_LOAD segments, and caches them so
+ *				  later launches of the same program skip the parse.
+ *				  A file without program headers is loaded whole at
+ *				  PROGADDR, like before. The parse is built in image and
+ *				  only goes into the cache once it has been checked, so a
+ *				  bad file never disturbs the slot.
+ */
+int32_t elf_load(uint32_t inode, elf_image_t* image)
+{
+	elf_image_t* cached = &elf_cache[inode % ELF_CACHE_SIZE];
+	elf_header_t header;
+	elf_phdr_t phdrs[ELF_MAX_PHDRS];
+	uint32_t length = inode_length(inode);
+	uint32_t count;
+	uint32_t i;
+
+	if (image == NULL)
+	{
+		return -1;
+	}
+	if (cached->valid && cached->inode == inode)
+	{
+		*image = *cached;
+		return 0;
+	}
+
+	if (read_data(inode, 0, (uint8_t*)&header, sizeof(header)) != sizeof(header))
+	{
+		return -1;
+	}
+
+	//magic elf checks
+	if (header.ident[0] != MAGIC0 ||
+		header.ident[1] != MAGIC1 ||
+		header.ident[2] != MAGIC2 ||
+		header.ident[3] != MAGIC3 ||
+		header.ident[EI_CLASS] != ELFCLASS32)
+	{
+		return -1;
+	}
+
+	image->valid = 0;
+	image->inode = inode;
+	image->entry = header.entry;
+	image->num_segments = 0;
+
+	if (header.phnum == 0)
+	{
+		if (elf_add_segment(image, PROGADDR, 0, length, length, length) == -1)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		if (header.phentsize != sizeof(elf_phdr_t))
+		{
+			return -1;
+		}
+
+		count = header.phnum;
+		if (count > ELF_MAX_PHDRS)										// segments past the last read would never be mapped
+		{
+			return -1;
+		}
+		if (read_data(inode, header.phoff, (uint8_t*)phdrs, count * sizeof(elf_phdr_t)) != count * sizeof(elf_phdr_t))
+		{
+			return -1;
+		}
+
+		for (i = 0; i < count; i++)										// section tables, debug info etc. are never loaded
+		{
+			if (phdrs[i].type != PT_LOAD || phdrs[i].memsz == 0)
+			{
+				continue;
+			}
+			if (elf_add_segment(image, phdrs[i].vaddr, phdrs[i].offset, phdrs[i].filesz, phdrs[i].memsz, length) == -1)
+			{
+				return -1;
+			}
+		}
+	}
+
+	if (image->num_segments == 0 || image->entry < _128MB || image->entry >= _128MB + _4MB)
+	{
+		return -1;
+	}
+
+	image->valid = 1;
+	*cached = *image;
+	return 0;
+}
+
+/*
+ *	int32_t elf_copy(const elf_image_t* image);
+ *  	Inputs: image - parsed executable
+ *  	Return Value: 0 on success, -1 if a segment could not be read
+ *		Function: Copies each segment to its address in the current
+ *				  program page and zeroes the rest of it (the bss).
+ *				  Used when the image isn't demand paged.
+ */
+int32_t elf_copy(const elf_image_t* image)
+{
+	const elf_segment_t* seg;
+	uint32_t i;
+
+	for (i = 0; i < image->num_segments; i++)
+	{
+		seg = &image->segment[i];
+		if (seg->filesz != 0 &&
+			read_data(image->inode, seg->offset, (uint8_t*)seg->vaddr, seg->filesz) != seg->filesz)
+		{
+			return -1;
+		}
+		memset((void*)(seg->vaddr + seg->filesz), 0, seg->memsz - seg->filesz);
+	}
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "types.h"
+
+/* ELF Constants */
+#define EI_NIDENT		16
+#define ELFCLASS32		1
+#define EI_CLASS		4
+#define PT_LOAD			1
+
+//elf magic 
+#define MAGIC0 0x7F
+#define MAGIC1 0x45
+#define MAGIC2 0x4C
+#define MAGIC3 0x46
+
+#define ELF_MAX_PHDRS		16		// most program headers an executable may have
+#define ELF_MAX_SEGMENTS	8		// PT_LOAD segments kept per executable
+#define ELF_CACHE_SIZE		64		// slots, picked by inode modulo the size
+
+/* ELF32 file header, as laid out in the file */
+typedef struct elf_header {
+	uint8_t ident[EI_NIDENT];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} elf_header_t;
+
+/* ELF32 program header, as laid out in the file */
+typedef struct elf_phdr {
+	uint32_t type;
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint32_t memsz;
+	uint32_t flags;
+	uint32_t align;
+} elf_phdr_t;
+
+/* One PT_LOAD segment: filesz bytes from offset, then zeroes up to memsz */
+typedef struct elf_segment {
+	uint32_t vaddr;
+	uint32_t offset;
+	uint32_t filesz;
+	uint32_t memsz;
+} elf_segment_t;
+
+/* Parsed executable */
+typedef struct elf_image {
+	uint32_t valid;
+	uint32_t inode;
+	uint32_t entry;
+	uint32_t num_segments;
+	elf_segment_t segment[ELF_MAX_SEGMENTS];
+} elf_image_t;
+
+/* Parses (or finds the cached parse of) an executable and copies it out */
+int32_t elf_load(uint32_t inode, elf_image_t* image);
+
+/* Copies every segment into the current address space */
+int32_t elf_copy(const elf_image_t* image);
+
+#endif
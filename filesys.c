@@ -6,9 +6,33 @@
 #include "filesys.h"
 #include "lib.h"
 #include "pcb.h"
+#include "sysfs.h"
+#include "serial.h"
+
+/* name -> directory_entry index, filled in by setup_fs */
+static dentry_slot_t dentry_index[DENTRY_HASH_SIZE];
 
 /* fs utilities */
 
+/*	name_hash
+ *	inputs: name	: file name, NUL terminated or NAME_SIZE long
+ *	outputs: 32-bit FNV-1a hash of the name
+ *	notes: Only the first NAME_SIZE characters are hashed, the same
+ *			characters read_dentry_by_name compares.
+ */
+static uint32_t name_hash(const uint8_t* name){
+
+	uint32_t hash = FNV_OFFSET;
+	uint32_t i;
+
+	for(i = 0; i < NAME_SIZE && name[i] != '\0'; i++){
+		hash ^= name[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
 /*	read_data
  *	inputs: inode 	: inode number
  *			offset	: position in file to begin reading
@@ -23,55 +47,59 @@
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
 	
 	inode_t* inode_ptr;
-	inode_ptr = (inode_t*)(&(boot[inode + 1]));
-	uint32_t filelength = inode_ptr->length; 
+	uint32_t filelength;
 	
 	// Arg checking
 	if(	length==0 || 
 		buf == NULL	||
-		inode > MAX_DATA_NUM){
+		inode >= boot->num_inodes){
 		return -1; 
 	}
 
-	// end of file reached if offset is larger than file
-	if(offset > filelength){
+	inode_ptr = (inode_t*)(&(boot[inode + 1]));
+	filelength = inode_ptr->length; 
+
+	// end of file reached if offset is at or past the end of the file
+	if(offset >= filelength){
 		return 0;
 	}
 
 	/* If the offset + length is longer than file, 
-		set the length to be read to filelength */
-	if( (offset + length) > filelength) {
-		length = filelength;
+		only read up to the end of the file */
+	if(length > filelength - offset) {
+		length = filelength - offset;
 	}
 
 	uint32_t maxblocks = boot->num_data_block;
-	uint32_t position = offset; 
-	uint32_t blocknum = position/BLOCK_SIZE;
-	uint32_t blockoff = position%BLOCK_SIZE;
+	uint32_t blocknum = offset/BLOCK_SIZE;		// only divide once per read
+	uint32_t blockoff = offset%BLOCK_SIZE;		// only the first block can start mid-block
 	uint32_t bytesread= 0; 
+	uint32_t chunk;
+	uint32_t block;
 
-	/* Read data into buffer a single byte at a time until
-		either end of file or length is reached*/
+	/* Copy the largest contiguous run in each data block at once,
+		until either a bad block or length is reached */
 	while(bytesread < length){
-		
-		// blocknum specifies the current block
-		blocknum = position/BLOCK_SIZE;
-		// blockoff is the current position in the block
-		blockoff = position%BLOCK_SIZE;
 
-		/* if either block or position reaches over end of file,
+		/* validate the block index once per block. if it is bad,
 			break, but do not return 0. */
-		if(inode_ptr->blocks[blocknum] >= maxblocks){
+		block = inode_ptr->blocks[blocknum];
+		if(block >= maxblocks){
 			break;
 		}
-		if(position > filelength){
-			break; 
+
+		// copy up to the end of the block, or up to length on the last block
+		chunk = BLOCK_SIZE - blockoff;
+		if(chunk > length - bytesread){
+			chunk = length - bytesread;
 		}
 
-		// copy over data one byte at a time
-		memcpy(buf+bytesread, &(data[inode_ptr->blocks[blocknum]].data[blockoff]), 1);
-		bytesread++;
-		position++;
+		memcpy(buf+bytesread, &(data[block].data[blockoff]), chunk);
+		bytesread += chunk;
+
+		// every block after the first starts at offset 0
+		blocknum++;
+		blockoff = 0;
 	}
 
 	return bytesread;
@@ -82,28 +110,41 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length
  *			dentry 	: dentry to be written to
  *	outputs: -1 if file not found
  *			  0 if file found
- *	notes: Finds the file in the filesystem and copies 
- *			over dentry metadata into given dentry
+ *	notes: Finds the file through the name index built by setup_fs
+ *			and copies over dentry metadata into given dentry.
+ *			A hit costs one hash and one final strncmp. Names not
+ *			in the boot image may still be the serial device or
+ *			sysfs stats files.
  */
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
 	
+	uint32_t hash;
+	uint32_t slot;
 	uint32_t i;
-	// Go through all the files one by one and find filename match
-	for (i = 0; i < MAX_FILES; i++) {
-		if (strncmp((int8_t*) (boot->directory_entry[i].name), (int8_t*) (fname), NAME_SIZE - 1) == 0) {
-			
-			*dentry = boot->directory_entry[i];
 
-			strcpy((int8_t*)(dentry->name), (int8_t*) (boot->directory_entry[i].name));
-			dentry->type = boot->directory_entry[i].type;
-			dentry->inode = boot->directory_entry[i].inode;
-		
+	if(fname == NULL || fname[0] == '\0'){
+		return -1;
+	}
+
+	// Walk the probe chain for this name's hash until an empty slot
+	hash = name_hash(fname);
+	for (slot = hash & DENTRY_HASH_MASK; dentry_index[slot].index != 0; slot = (slot + 1) & DENTRY_HASH_MASK) {
+		if (dentry_index[slot].hash != hash) {
+			continue;
+		}
+
+		i = dentry_index[slot].index - 1;
+		if (strncmp((int8_t*) (boot->directory_entry[i].name), (int8_t*) (fname), NAME_SIZE) == 0) {
+			*dentry = boot->directory_entry[i];
 			return 0;
 		}
 	}
 
-	// Failed to find file
-	return -1;
+	// Not in the boot image, try the devices and stats files
+	if (serial_lookup(fname, dentry) == 0) {
+		return 0;
+	}
+	return sysfs_lookup(fname, dentry);
 }
 
 /*	read_dentry_by_index
@@ -136,7 +177,8 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
  *	inputs: boot_ptr: pointer to filesystem
  *	outputs: none
  *	notes: maps filesystem boot block and data block to 
- * 			correct position given a boot pointer
+ * 			correct position given a boot pointer, then builds
+ *			the hashed name index used by read_dentry_by_name
  */
 void setup_fs(uint32_t boot_ptr)
 {
@@ -144,6 +186,34 @@ void setup_fs(uint32_t boot_ptr)
 	
 	// data is 31*4kb away from beginning of boot block. (30 inodes+1) 
 	data = (data_block_t*)(boot_ptr + BLOCK_SIZE + boot->num_inodes * BLOCK_SIZE); 
+
+	uint32_t i;
+	uint32_t slot;
+	uint32_t hash;
+	uint32_t entries = boot->num_directory_entry;
+	dentry_t unused;
+
+	if(entries > MAX_FILES){
+		entries = MAX_FILES;
+	}
+
+	/* The image is read-only, so the name index only has to be built once.
+		Duplicate names keep the first entry, like the old linear scan. */
+	memset(dentry_index, 0, sizeof(dentry_index));
+	for(i = 0; i < entries; i++){
+		if(boot->directory_entry[i].name[0] == '\0' ||
+			read_dentry_by_name(boot->directory_entry[i].name, &unused) == 0){
+			continue;
+		}
+
+		hash = name_hash(boot->directory_entry[i].name);
+		slot = hash & DENTRY_HASH_MASK;
+		while(dentry_index[slot].index != 0){
+			slot = (slot + 1) & DENTRY_HASH_MASK;
+		}
+		dentry_index[slot].hash = hash;
+		dentry_index[slot].index = i + 1;
+	}
 }
 
 /*	inode_length
@@ -157,6 +227,27 @@ uint32_t inode_length(uint32_t inode){
 	return inode_ptr->length; 
 }
 
+/*	data_block_addr
+ *	inputs: inode : inode number in filesystem
+ *			index : block index within the file
+ *	outputs: address of the data block, 0 if either index is invalid
+ *	notes: Lets paging map file blocks in place instead of copying them
+ */
+uint32_t data_block_addr(uint32_t inode, uint32_t index){
+	inode_t* inode_ptr;
+
+	if(inode >= boot->num_inodes || index >= MAX_DATA_NUM){
+		return 0;
+	}
+
+	inode_ptr = (inode_t*)(&(boot[inode + 1]));
+	if(inode_ptr->blocks[index] >= boot->num_data_block){
+		return 0;
+	}
+
+	return (uint32_t)&(data[inode_ptr->blocks[index]]);
+}
+
 /* fs syscalls */
 
 /*	The following functions are not defined in our current filesystem
@@ -215,8 +306,8 @@ int32_t fs_read(int32_t fd, void* buf, int32_t nbytes) {
 		return -1;
 	}
 
-	inum = pcb_loc[current_terminal]->file_desc[fd].inode_ptr; // we need to fix this because its a temp fa 
-	readpos = pcb_loc[current_terminal]->file_desc[fd].file_pos; 
+	inum = pcb_loc[sched_terminal]->file_desc[fd].inode_ptr; // we need to fix this because its a temp fa 
+	readpos = pcb_loc[sched_terminal]->file_desc[fd].file_pos; 
 	flent = inode_length(inum);
 	inode_t* inode_ptr;
 	inode_ptr = (inode_t*)(&(boot[inum + 1]));
@@ -233,7 +324,7 @@ int32_t fs_read(int32_t fd, void* buf, int32_t nbytes) {
 		return -1; 
 	}
 	//update file position
-	pcb_loc[current_terminal]->file_desc[fd].file_pos += check; // we need to fix this because its a temp fa 
+	pcb_loc[sched_terminal]->file_desc[fd].file_pos += check; // we need to fix this because its a temp fa 
 	
 	//returns number of read bytes
 	return check;
@@ -279,7 +370,7 @@ int32_t dir_close(int32_t fd){
  *			0 signfies that directory has been completely read	
  *			otherwise, number of bytes read
  *	notes: Same as fs_read, except only file names are read
- * 			into buffer
+ * 			into buffer. The sysfs stats files come last.
  */
 int32_t dir_read(int32_t fd, void* buf, int32_t nbytes){
 	
@@ -291,8 +382,14 @@ int32_t dir_read(int32_t fd, void* buf, int32_t nbytes){
 		return -1;
 	}
 
-	readpos = pcb_loc[current_terminal]->file_desc[fd].file_pos; 
-	check = read_dentry_by_index(readpos, &curr_dentry);
+	readpos = pcb_loc[sched_terminal]->file_desc[fd].file_pos; 
+	if(readpos < boot->num_directory_entry){
+		check = read_dentry_by_index(readpos, &curr_dentry);
+	}
+	else{
+		// the stats files are listed after the boot image's entries
+		check = sysfs_dentry(readpos - boot->num_directory_entry, &curr_dentry);
+	}
 	
 	/* if either name is null, or file is not found, return 0
 		to signal that directory has finished reading*/
@@ -316,7 +413,7 @@ int32_t dir_read(int32_t fd, void* buf, int32_t nbytes){
 	//update file position
 	readpos++;
 	//returns number of read bytes
-	pcb_loc[current_terminal]->file_desc[fd].file_pos = readpos;
+	pcb_loc[sched_terminal]->file_desc[fd].file_pos = readpos;
 
 	return nbytes;
 }
@@ -11,6 +11,12 @@
 #define ENTRY_RESERVE 24
 #define _BLOCK_SIZE 4096
 
+/* Directory name index, built once at mount time */
+#define DENTRY_HASH_SIZE 128			// power of two, at least twice MAX_FILES
+#define DENTRY_HASH_MASK (DENTRY_HASH_SIZE - 1)
+#define FNV_OFFSET 0x811C9DC5			// 32-bit FNV-1a parameters
+#define FNV_PRIME 0x01000193
+
 typedef struct dentry {
 	uint8_t name[NAME_SIZE];
 	uint32_t type; 
@@ -37,6 +43,14 @@ typedef struct boot_block
 	dentry_t directory_entry[MAX_FILES];
 } boot_block_t;
 
+/* One slot of the open-addressed name index. The full hash is kept so a
+	probe only falls back to a string compare on a real hash match. */
+typedef struct dentry_slot
+{
+	uint32_t hash;
+	uint32_t index;				// directory_entry index + 1, 0 marks an empty slot
+} dentry_slot_t;
+
 // filesystem functions for 
 int32_t fs_open(const uint8_t * filename);
 int32_t fs_close(int32_t fd);
@@ -47,6 +61,7 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 uint32_t inode_length(uint32_t inode);
+uint32_t data_block_addr(uint32_t inode, uint32_t index);
 
 int32_t dir_open(const uint8_t * filename);
 int32_t dir_close(int32_t fd);
@@ -0,0 +1,236 @@
+/**
+***	frame.c: Physical page frame allocator.
+**/
+
+#include "frame.h"
+#include "lib.h"
+
+/* One bit per 4KB frame below FRAME_LIMIT, set while the frame is in use */
+static uint32_t frame_map[FRAME_WORDS];
+
+/* Frames currently clear in frame_map */
+static uint32_t frames_free = 0;
+
+/* Bitmap word the next single-frame search starts at */
+static uint32_t frame_hint = FRAME_BASE >> (FRAME_SHIFT + 5);
+
+/*
+ * frame_range
+ * Marks every frame in [start, end) as free or in use
+ * INPUTS: start, end - physical byte range
+ *		   used - 1 to reserve, 0 to release
+ * OUTPUTS: none
+ * EFFECTS: Released ranges only cover whole frames inside them, reserved
+ *			ranges cover any frame they touch. Nothing outside
+ *			[FRAME_BASE, FRAME_LIMIT) is ever handed out.
+ */
+static void frame_range(uint32_t start, uint32_t end, uint32_t used)
+{
+	uint32_t frame;
+	uint32_t last;
+	uint32_t bit;
+
+	if (used)
+	{
+		start = start & ~(FRAME_SIZE - 1);
+		end = (end > FRAME_LIMIT - FRAME_SIZE) ? FRAME_LIMIT : (end + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+	}
+	else
+	{
+		start = (start > FRAME_LIMIT - FRAME_SIZE) ? FRAME_LIMIT : (start + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+		end = end & ~(FRAME_SIZE - 1);
+	}
+	if (start < FRAME_BASE)
+	{
+		start = FRAME_BASE;
+	}
+	if (end > FRAME_LIMIT)
+	{
+		end = FRAME_LIMIT;
+	}
+
+	last = end >> FRAME_SHIFT;
+	for (frame = start >> FRAME_SHIFT; frame < last; frame++)
+	{
+		bit = 1 << (frame & 31);
+		if (used && !(frame_map[frame >> 5] & bit))
+		{
+			frame_map[frame >> 5] |= bit;
+			frames_free--;
+		}
+		else if (!used && (frame_map[frame >> 5] & bit))
+		{
+			frame_map[frame >> 5] &= ~bit;
+			frames_free++;
+		}
+	}
+}
+
+/*
+ * frame_init
+ * Seeds the allocator from the multiboot memory map
+ * INPUTS: mbi - multiboot information from the boot loader
+ * OUTPUTS: none
+ * EFFECTS: Every frame starts out in use. Available mmap regions are
+ *			released, falling back to mem_upper when there is no map,
+ *			then boot modules (the filesystem image) are reserved again.
+ *			Must run before paging_init, while mbi is still reachable.
+ */
+void frame_init(multiboot_info_t* mbi)
+{
+	memory_map_t* mmap;
+	module_t* mod;
+	uint32_t end;
+	uint32_t i;
+
+	memset(frame_map, 0xFF, sizeof(frame_map));
+	frames_free = 0;
+
+	if (mbi->flags & MBI_MMAP)
+	{
+		for (mmap = (memory_map_t*)mbi->mmap_addr;
+			(uint32_t)mmap < mbi->mmap_addr + mbi->mmap_length;
+			mmap = (memory_map_t*)((uint32_t)mmap + mmap->size + sizeof(mmap->size)))
+		{
+			if (mmap->type != MMAP_AVAILABLE || mmap->base_addr_high != 0)
+			{
+				continue;
+			}
+			end = mmap->base_addr_low + mmap->length_low;
+			if (mmap->length_high != 0 || end < mmap->base_addr_low)	// runs past 4GB
+			{
+				end = FRAME_LIMIT;
+			}
+			frame_range(mmap->base_addr_low, end, 0);
+		}
+	}
+	else if (mbi->flags & MBI_MEM)
+	{
+		frame_range(UPPER_MEM_BASE, UPPER_MEM_BASE + (mbi->mem_upper << KB_SHIFT), 0);
+	}
+
+	if (mbi->flags & MBI_MODS)
+	{
+		mod = (module_t*)mbi->mods_addr;
+		for (i = 0; i < mbi->mods_count; i++)
+		{
+			frame_range(mod[i].mod_start, mod[i].mod_end, 1);
+		}
+	}
+}
+
+/*
+ * frame_alloc
+ * Takes one free frame
+ * INPUTS: none
+ * OUTPUTS: physical address of the frame, 0 if memory is exhausted
+ * EFFECTS: Scans a word (32 frames) at a time from where the last
+ *			allocation left off. The frame is not cleared.
+ */
+uint32_t frame_alloc(void)
+{
+	uint32_t word;
+	uint32_t i;
+	uint32_t bit;
+
+	if (frames_free == 0)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < FRAME_WORDS; i++)
+	{
+		word = frame_hint + i;
+		if (word >= FRAME_WORDS)
+		{
+			word -= FRAME_WORDS;
+		}
+		if (frame_map[word] != FRAME_FULL)
+		{
+			bit = __builtin_ctz(~frame_map[word]);
+			frame_map[word] |= 1 << bit;
+			frames_free--;
+			frame_hint = word;
+			return ((word << 5) + bit) << FRAME_SHIFT;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * frame_alloc_contig
+ * Takes a run of physically contiguous frames
+ * INPUTS: count - number of frames
+ * OUTPUTS: physical address of the first frame, 0 if no run is long enough
+ * EFFECTS: First fit from FRAME_BASE. Only used for the few multi-frame
+ *			kernel objects (kernel stacks, page table sets), so a plain
+ *			bit-by-bit scan is enough.
+ */
+uint32_t frame_alloc_contig(uint32_t count)
+{
+	uint32_t frame;
+	uint32_t run = 0;
+
+	if (count == 0 || count > frames_free)
+	{
+		return 0;
+	}
+
+	for (frame = FRAME_BASE >> FRAME_SHIFT; frame < FRAME_COUNT; frame++)
+	{
+		if (frame_map[frame >> 5] & (1 << (frame & 31)))
+		{
+			run = 0;
+			continue;
+		}
+		if (++run == count)
+		{
+			frame = frame + 1 - count;
+			frame_range(frame << FRAME_SHIFT, (frame + count) << FRAME_SHIFT, 1);
+			return frame << FRAME_SHIFT;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * frame_free
+ * Returns one frame to the allocator
+ * INPUTS: addr - physical address from frame_alloc
+ * OUTPUTS: none
+ * EFFECTS: Addresses outside the managed range are ignored.
+ */
+void frame_free(uint32_t addr)
+{
+	frame_free_contig(addr, 1);
+}
+
+/*
+ * frame_free_contig
+ * Returns a run of frames to the allocator
+ * INPUTS: addr - physical address from frame_alloc_contig
+ *		   count - number of frames in the run
+ * OUTPUTS: none
+ * EFFECTS: none
+ */
+void frame_free_contig(uint32_t addr, uint32_t count)
+{
+	if (addr < FRAME_BASE || addr >= FRAME_LIMIT)
+	{
+		return;
+	}
+	frame_range(addr, addr + count * FRAME_SIZE, 0);
+}
+
+/*
+ * frame_free_count
+ * INPUTS: none
+ * OUTPUTS: number of frames that can still be allocated
+ * EFFECTS: none
+ */
+uint32_t frame_free_count(void)
+{
+	return frames_free;
+}
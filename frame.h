@@ -0,0 +1,40 @@
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "types.h"
+#include "multiboot.h"
+
+/* Frame Allocator Constants */
+#define FRAME_SIZE		4096
+#define FRAME_SHIFT		12
+#define FRAME_BASE		0x00800000	// everything below 8MB belongs to the kernel image
+#define FRAME_LIMIT		0x08000000	// the kernel direct map ends where user space begins
+#define FRAME_COUNT		(FRAME_LIMIT >> FRAME_SHIFT)
+#define FRAME_WORDS		(FRAME_COUNT / 32)
+#define FRAME_FULL		0xFFFFFFFF	// bitmap word with every frame in use
+
+/* Multiboot Memory Information */
+#define MBI_MEM			0x00000001	// mem_lower/mem_upper are valid
+#define MBI_MODS		0x00000008	// mods_addr/mods_count are valid
+#define MBI_MMAP		0x00000040	// mmap_addr/mmap_length are valid
+#define MMAP_AVAILABLE	1			// mmap type for usable RAM
+#define UPPER_MEM_BASE	0x00100000	// mem_upper is counted from 1MB
+#define KB_SHIFT		10
+
+/* Builds the free frame bitmap from the boot loader's memory map */
+void frame_init(multiboot_info_t* mbi);
+
+/* Allocates one frame, returns its physical address or 0 */
+uint32_t frame_alloc(void);
+
+/* Allocates count physically contiguous frames, returns the first or 0 */
+uint32_t frame_alloc_contig(uint32_t count);
+
+/* Returns frames to the allocator */
+void frame_free(uint32_t addr);
+void frame_free_contig(uint32_t addr, uint32_t count);
+
+/* Number of frames left */
+uint32_t frame_free_count(void);
+
+#endif
@@ -8,6 +8,7 @@
 /* Indices for Interrupts */
 #define PIT_IDT			32
 #define KEYBOARD_IDT 	33
+#define SERIAL_IDT 		36
 #define RTC_IDT 		40
 
 /* Function Declarations */
@@ -40,5 +41,6 @@ extern void floating_point1(void);
 extern void pit1(void);
 extern void keyboard1(void);
 extern void rtc1(void);
+extern void serial1(void);
 
 #endif
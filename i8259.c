@@ -10,6 +10,9 @@
 uint8_t master_mask; /* IRQs 0-7 */
 uint8_t slave_mask; /* IRQs 8-15 */
 
+/* Interrupts taken on each line, counted by the handlers in idt.c */
+uint32_t irq_count[IRQ_LINES];
+
 /*
  *	void i8259_init(void);
  *  	Inputs: void
@@ -32,12 +32,16 @@
 #define IRQ_MAX		0x08  // the number of irqs on a PIC
 #define BIT_MASK    0x01
 #define SLAVE_IRQ   0x02
+#define IRQ_LINES   0x10  // irqs on both PICs
 
 /* End-of-interrupt byte.  This gets OR'd with
  * the interrupt number and sent out to the PIC
  * to declare the interrupt finished */
 #define EOI             0x60
 
+/* Interrupts taken on each IRQ line since boot */
+extern uint32_t irq_count[IRQ_LINES];
+
 /* Externally-visible functions */
 
 /* Initialize both PICs */
@@ -9,8 +9,12 @@
 #include "i8259.h"
 #include "keyboard.h"
 #include "rtc.h"
+#include "serial.h"
 #include "pit.h"
 #include "syscall.h"
+#include "prof.h"
+#include "trace.h"
+#include "klog.h"
 
 /*
  *	void divide_zero(void);
@@ -195,12 +199,14 @@ void general_protection_fault(void)
 }
 
 /*
- *	void page_fault(void);
- *  	Inputs: void
+ *	void page_fault(uint32_t error);
+ *  	Inputs: error - error code pushed by the processor
  *  	Return Value: none
- *		Function: Reports a page fault.
+ *		Function: Pages in the program image on first touch. Any other
+ *				  fault in a program kills just that program, a fault
+ *				  in the kernel itself is reported.
  */
-void page_fault(void)
+void page_fault(uint32_t error)
 {
 	cli();
 	uint32_t paddr=0; 
@@ -212,6 +218,22 @@ void page_fault(void)
 		://no inputs
 		:"eax"
 		);
+	TRACE(TR_PAGE_FAULT, paddr);
+
+	// first touch of a program page, or a write to a mapped block
+	if(prog_count[sched_terminal] != 0 &&
+		page_in(paddr, error, pcb_loc[sched_terminal]->pid) == 0)
+	{
+		return;
+	}
+
+	// a bad access by the program only takes down the program
+	if(prog_count[sched_terminal] != 0 &&
+		((error & PF_USER) || (paddr >= _128MB && paddr < _128MB + _4MB)))
+	{
+		klog(KLOG_ERR, "page fault at 0x%#x, killing pid %d", paddr, pcb_loc[sched_terminal]->pid);
+		halt_status(EXCEPTION_STATUS);
+	}
 
 	printf("Page-Fault at address: 0x%x\n",paddr);
 	while(1);
@@ -283,13 +305,16 @@ void floating_point(void)
 }
 
 /*
- *	void pit(void);
- *  	Inputs: void
+ *	void pit(irq_frame_t* frame);
+ *  	Inputs: frame - the interrupted registers
  *  	Return Value: none
- *		Function: Calls the pit handler.
+ *		Function: Samples the interrupted code for the profiler, then
+ *				  calls the pit handler.
  */
-void pit(void)
+void pit(irq_frame_t* frame)
 {
+	irq_count[PIT]++;
+	prof_sample(frame);
 	pit_handler();
 }
 
@@ -301,6 +326,7 @@ void pit(void)
  */
 void keyboard(void)
 {
+	irq_count[KEYBOARD]++;
 	keyboard_handler();
 }
 
@@ -312,9 +338,22 @@ void keyboard(void)
  */
 void rtc(void)
 {
+	irq_count[RTC]++;
 	rtc_handler();
 }
 
+/*
+ *	void serial(void);
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Calls the serial handler.
+ */
+void serial(void)
+{
+	irq_count[SERIAL]++;
+	serial_handler();
+}
+
 void setup_exceptions(void)
 {
 	int32_t i;
@@ -353,14 +392,14 @@ void setup_exceptions(void)
 	SET_IDT_ENTRY(idt[18], (uint32_t)&machine_check1);
 	SET_IDT_ENTRY(idt[19], (uint32_t)&floating_point1);
 
-	//setup PIT
+	//setup PIT, the irqs use interrupt gates (reserved3 = 0) so their handlers run with interrupts off
 	idt[PIT_IDT].present = 1;
 	idt[PIT_IDT].dpl = 0;
 	idt[PIT_IDT].reserved0 = 0;
 	idt[PIT_IDT].size = 1; 
 	idt[PIT_IDT].reserved1 = 1;
 	idt[PIT_IDT].reserved2 = 1;
-	idt[PIT_IDT].reserved3 = 1;
+	idt[PIT_IDT].reserved3 = 0;
 	idt[PIT_IDT].seg_selector = KERNEL_CS;
 	SET_IDT_ENTRY(idt[PIT_IDT], (uint32_t)&pit1);	
 
@@ -371,7 +410,7 @@ void setup_exceptions(void)
 	idt[KEYBOARD_IDT].size = 1; 
 	idt[KEYBOARD_IDT].reserved1 = 1;
 	idt[KEYBOARD_IDT].reserved2 = 1;
-	idt[KEYBOARD_IDT].reserved3 = 1;
+	idt[KEYBOARD_IDT].reserved3 = 0;
 	idt[KEYBOARD_IDT].seg_selector = KERNEL_CS;
 	SET_IDT_ENTRY(idt[KEYBOARD_IDT], (uint32_t)&keyboard1);	
 	
@@ -382,10 +421,21 @@ void setup_exceptions(void)
 	idt[RTC_IDT].size = 1;
 	idt[RTC_IDT].reserved1 = 1;
 	idt[RTC_IDT].reserved2 = 1;
-	idt[RTC_IDT].reserved3 = 1;
+	idt[RTC_IDT].reserved3 = 0;
 	idt[RTC_IDT].seg_selector = KERNEL_CS;
 	SET_IDT_ENTRY(idt[RTC_IDT], (uint32_t)&rtc1);
 
+	//setup serial
+	idt[SERIAL_IDT].present = 1;
+	idt[SERIAL_IDT].dpl = 0;
+	idt[SERIAL_IDT].reserved0 = 0;
+	idt[SERIAL_IDT].size = 1;
+	idt[SERIAL_IDT].reserved1 = 1;
+	idt[SERIAL_IDT].reserved2 = 1;
+	idt[SERIAL_IDT].reserved3 = 0;
+	idt[SERIAL_IDT].seg_selector = KERNEL_CS;
+	SET_IDT_ENTRY(idt[SERIAL_IDT], (uint32_t)&serial1);
+
 	//setup syscalls
 	idt[SYSCALLS].present = 1;
 	idt[SYSCALLS].dpl = USERPRV; 			// user privilege
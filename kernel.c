@@ -10,11 +10,15 @@
 #include "handlers.h"
 #include "keyboard.h"
 #include "rtc.h"
+#include "serial.h"
 #include "paging.h"
 #include "filesys.h"
 #include "syscall.h"
 #include "pcb.h"
 #include "pit.h"
+#include "sched.h"
+#include "trace.h"
+#include "klog.h"
 
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
@@ -153,7 +157,8 @@ entry (unsigned long magic, unsigned long addr)
 
 	clear();
 	setcoords(0,0,0);
-	// setup paging
+	// hand the free memory to the frame allocator, then setup paging
+	frame_init(mbi);
 	paging_init();
 	// find starting address of filesystem
 	module_t* fsmod = (module_t*)mbi->mods_addr;
@@ -167,14 +172,30 @@ entry (unsigned long magic, unsigned long addr)
 	 * PIC, any other initialization stuff... 
 	 */
 	setup_exceptions();
+	sysenter_init();
 	
 
 	
+	/* RTC runs at a fixed rate, rtc fds divide it down */
+	rtc_init();
+
+	/* COM1 carries kernel output and trace dumps, -serial stdio in QEMU */
+	serial_init();
+
+	/* Timers tick at TIMER_HZ, the scheduler runs every SCHED_TICKS */
+	timer_init();
+	clock_init();
+	sched_init();
+	klog_init();
+	trace_init();
+	set_pit_rate(TIMER_HZ);
+
 	/* Enable Interrupts */
 	enable_irq(SLAVE);
-	//enable_irq(PIT);
+	enable_irq(PIT);
 	enable_irq(KEYBOARD);
 	enable_irq(RTC);
+	enable_irq(SERIAL);
  
 	/* Do not enable the following until after you have set up your
 	 * IDT correctly otherwise QEMU will triple fault and simple close
@@ -187,9 +208,8 @@ entry (unsigned long magic, unsigned long addr)
 		//rtc_init();
 		/*rtc_open(0);
 
-		char rtcbuf[1];
-		rtcbuf[0] = 64;
-		rtc_write(0, rtcbuf, 0);
+		int32_t rtcfreq = 64;
+		rtc_write(0, (char*)&rtcfreq, 4);
 		*/
 
 	/* Terminal Tests */
@@ -211,6 +231,11 @@ entry (unsigned long magic, unsigned long addr)
 		//set_pit_rate(100); // sets pit at 100 interrupts/second or a timeslice of 10ms
 
 	/*paging tests*/
+		//tlb_bench();
+		//slab_stats();
+		//sched_stats();
+		//syscall_bench();
+		//trace_drain();
 		/*
 		int a = 0;
 		int *p = &a;
@@ -241,10 +266,7 @@ entry (unsigned long magic, unsigned long addr)
 		
 
 	/* Execute the first program ('shell') ... */
-	while(1){
-		execute((uint8_t*)"shell");
-		printk("Relaunching Shell... \n");
-	}
+	terminal_main(TERM_1);
 
 	/* Spin (nicely, so we don't chew up cycles) */
 	asm volatile(".1: hlt; jmp .1;");
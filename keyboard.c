@@ -3,6 +3,8 @@
 **/
 
 #include "keyboard.h"
+#include "sched.h"
+#include "trace.h"
 
 /**
 ***	Global Variables:
@@ -16,6 +18,12 @@ static int functionflags[NUMTERMINALS][FUNCTIONSIZE] = { {OFF, OFF, OFF, OFF},
 static volatile int enter_flag[NUMTERMINALS] = {OFF, OFF, OFF};
 static volatile int read_flag[NUMTERMINALS] = {OFF, OFF, OFF};
 
+/* the last byte from the keyboard was the EXTENDED prefix */
+static int extended = OFF;
+
+/* terminal_read callers sleeping until ENTER, per terminal */
+static wait_queue_t read_queue[NUMTERMINALS] = {WAIT_QUEUE_INIT, WAIT_QUEUE_INIT, WAIT_QUEUE_INIT};
+
 /* Buffer and index */
 static char keyboardbuffer[NUMTERMINALS][BUFFERSIZE];
 static int bufferindex[NUMTERMINALS] = {0, 0, 0};
@@ -29,6 +37,7 @@ static char thirdarray[EIGHTBITS];	// 	uppercase letters and numbers
 static char fourtharray[EIGHTBITS];	// 	lowercase letters and special characters
 
 int32_t current_terminal = 0;
+int32_t sched_terminal = 0;
 
 
 
@@ -47,9 +56,9 @@ void clear_keyboard_buffer(int terminal)
 	int i;
 	for (i = 0; i < BUFFERSIZE; i++)
 	{
-		keyboardbuffer[current_terminal][i] = 0;								// initialize keyboard buffer
+		keyboardbuffer[terminal][i] = 0;										// initialize keyboard buffer
 	}
-	bufferindex[current_terminal] = 0;											// reset index
+	bufferindex[terminal] = 0;													// reset index
 }
 
 /*
@@ -63,10 +72,32 @@ void keyboard_handler(void)
 	int i;
 	uint8_t scancode = inb(KB_ENCODER);
 	int32_t ascii;
+	int prefixed = extended;
 	init_arrays();
 
+	extended = OFF;
+	if (prefixed == ON && (scancode & ~KEYRELEASE) == LSHIFT)								// fake shift some keyboards wrap the grey keys in
+	{
+		send_eoi(KEYBOARD);
+		return;
+	}
+	if (prefixed == ON && (scancode == PAGEUP || scancode == PAGEDOWN))							// grey page up/down, unprefixed they are keypad 9/3
+	{
+		if (functionflags[current_terminal][SHIFTINDEX] == ON)									// shift + page up/down pages through the scrollback
+		{
+			scrollback(current_terminal, scancode == PAGEUP ? SCROLLBACK_PAGE : -SCROLLBACK_PAGE);
+		}
+		send_eoi(KEYBOARD);
+		return;
+	}
+
 	switch (scancode) 																				// identify the key pressed and handle it accordingly
 	{
+		case EXTENDED:
+			extended = ON;																			// the next byte says which grey key
+			send_eoi(KEYBOARD);
+			return;
+
 		case ALT:
 			functionflags[current_terminal][ALTINDEX] = ON;											// turn on the alt flag
 			send_eoi(KEYBOARD);
@@ -155,11 +186,12 @@ void keyboard_handler(void)
 			(bufferindex[current_terminal])++;
 
 			enter_flag[current_terminal] = ON;
+			wake_all(&read_queue[current_terminal]);
 
-			term_putc('\n');
+			term_putc_to(current_terminal, '\n');
 			if (bufferindex[current_terminal] + writeindex[current_terminal] > NUM_COLS + 1)		// edge case
 			{
-				term_putc('\n');	
+				term_putc_to(current_terminal, '\n');	
 			}
 
 			if (read_flag[current_terminal] == OFF)													// case for terminal_read
@@ -169,8 +201,7 @@ void keyboard_handler(void)
 
 			send_eoi(KEYBOARD);
 			return;
-		case ENTERRELEASE:
-			enter_flag[current_terminal] = OFF;														// turn off the enter flag
+		case ENTERRELEASE:																			// enter_flag stays on until the reader has seen it
 			send_eoi(KEYBOARD);
 			return;
 
@@ -290,10 +321,10 @@ int32_t terminal_open(const uint8_t * filename)
 	
 	for (i = 0; i < FUNCTIONSIZE; i++) 							// initialize function keys to OFF
 	{
-		functionflags[current_terminal][i] = OFF;
+		functionflags[sched_terminal][i] = OFF;
 	}
 
-	clear_keyboard_buffer(current_terminal);
+	clear_keyboard_buffer(sched_terminal);
 	return 0;
 }
 
@@ -311,7 +342,7 @@ int32_t terminal_open(const uint8_t * filename)
  */
 int32_t terminal_read(int32_t fd, char * buf, int32_t nbytes)
 {
-	int current_terminal_read = current_terminal; 				// sets this for the entire duration of terminal_read
+	int current_terminal_read = sched_terminal; 				// the reader's terminal, even while another is displayed
 	int i;
 	int bytes_read = 0;
 
@@ -323,12 +354,15 @@ int32_t terminal_read(int32_t fd, char * buf, int32_t nbytes)
 	{
 		return -1;
 	}
-	sti();
+	cli();
 
 	enter_flag[current_terminal_read] = OFF;
 	read_flag[current_terminal_read] = ON;
 
-	while (enter_flag[current_terminal_read] == OFF); 			// spin in this while loop until enter is pressed
+	while (enter_flag[current_terminal_read] == OFF) 			// sleep until enter is pressed, other tasks run meanwhile
+	{
+		sleep_on(&read_queue[current_terminal_read]);
+	}
 
 	for (i = 0; i < nbytes; i++) 								// clear the buffer
 	{
@@ -345,7 +379,7 @@ int32_t terminal_read(int32_t fd, char * buf, int32_t nbytes)
 		}
 	}
 
-	clear_keyboard_buffer(current_terminal);
+	clear_keyboard_buffer(current_terminal_read);
 
 	read_flag[current_terminal_read] = OFF;
 	return bytes_read;
@@ -371,18 +405,21 @@ int32_t terminal_write(int32_t fd, const char * buf, int32_t nbytes)
 		return -1;
 	}
 
-	for (i = 0; i < nbytes; i++)										// clear out the writebuffer
+	for (i = 0; i < nbytes && i < BUFFERSIZE; i++)						// clear out the writebuffer
 	{
-		writebuffer[current_terminal][i] = 0;
+		writebuffer[sched_terminal][i] = 0;
 	}
 
-	writeindex[current_terminal] = 0;
+	writeindex[sched_terminal] = 0;
 	for (i = 0; i < nbytes; i++)
 	{
-		writebuffer[current_terminal][i] = *(buf + i);					// add the current character to the writebuffer and increment the index
-		writeindex[current_terminal]++;
+		if (i < BUFFERSIZE)
+		{
+			writebuffer[sched_terminal][i] = *(buf + i);				// add the current character to the writebuffer and increment the index
+			writeindex[sched_terminal]++;
+		}
 
-		if (*(buf + i) != '\n' || getxcoord(current_terminal) != 0)		// have term_putc handle everything unless there's a new line character 
+		if (*(buf + i) != '\n' || getxcoord(sched_terminal) != 0)		// have term_putc handle everything unless there's a new line character 
 		{
 			term_putc(*(buf + i));
 		}
@@ -402,22 +439,53 @@ int32_t terminal_close(int32_t fd)
 	return -1;
 }
 
+/*
+ *	void terminal_vidmap(int32_t terminal);
+ *  	Inputs: terminal - terminal whose programs need their vidmap page updated
+ *   	Return Value: none
+ *		Function: Points the vidmap page of every program on the terminal
+ *				  (the running one and the parents waiting on it) at the
+ *				  screen or at the terminal's background buffer.
+ */
+static void terminal_vidmap(int32_t terminal)
+{
+	pcb_t* pcb;
+
+	if (prog_count[terminal] == 0)
+	{
+		return;
+	}
+
+	for (pcb = pcb_loc[terminal]; ; pcb = pcb->lastpcb_ptr)
+	{
+		prog_vidmap(pcb->pid, terminal);
+		if (pcb->lastpcb_ptr == pcb)								// the first shell is its own parent
+		{
+			break;
+		}
+	}
+}
+
 /*
  *	int32_t terminal_switch(int32_t term_num);
  *  	Inputs: term_num - terminal number we want to switch to
  *   	Return Value: Returns 0 on success.
- *		Function: Switches the active terminal.
+ *		Function: Switches the displayed terminal. Programs on every
+ *				  terminal keep running under the scheduler, so only the
+ *				  screen contents and vidmap pages move. A terminal shown
+ *				  for the first time gets a task that starts its shell.
  */
 int32_t terminal_switch(int32_t term_num)
 {
 	int32_t * buf_loc = NULL;										// pointer to the background buffer location
-	int32_t espsave;	
-	int32_t ebpsave;
+	int32_t old_terminal = current_terminal;
 
 	if(current_terminal == term_num)
 	{
 		return 0;
 	}
+	TRACE(TR_TERM_SWITCH, term_num);
+	vga_reset();													// the screen may sit further into the text buffer after scrolling
 
 	switch(current_terminal) 										// save the current video memory into corresponding background buffer
 	{
@@ -454,51 +522,17 @@ int32_t terminal_switch(int32_t term_num)
         *(uint8_t *)(VID_MEM + (i << 1) + 1) = LINEATTRIBUTE;
     }
 
-	asm volatile("movl %%esp, %0" 
-                     : "=a"(espsave)
-                     :
-                     : "cc" );
-
-	asm volatile("movl %%ebp, %0" 
-                     : "=a"(ebpsave)
-                     :
-                     : "cc" );
-
-	pcb_loc[current_terminal]->curr_esp = espsave; 					// save esp
-	pcb_loc[current_terminal]->curr_ebp = ebpsave;					// save ebp
+	current_terminal = term_num;									// change the displayed terminal
 
-	current_terminal = term_num;									// change the current terminal
-	send_eoi(KEYBOARD);
+	terminal_vidmap(old_terminal);									// old terminal's programs now draw into its buffer
+	terminal_vidmap(current_terminal);
 
-	if (prog_count[current_terminal] == 0)
+	if (prog_count[current_terminal] == 0 && (!can_execute() || sched_add_terminal(current_terminal) == -1))
 	{
-		if (prog_count[TERM_1] + prog_count[TERM_2] + prog_count[TERM_3] < MAX_PROCESSES)
-		{
-			while(1)
-			{
-				execute((uint8_t*)"shell");
-				printk("Relaunching Shell...\n");
-			}
-		}
-		else
-		{
-			clear();
-			keyboard_helper();
-			return 0;
-		}
+		clear();
+		keyboard_helper();
 	}
 
-	tss.ss0 = KERNEL_DS;
-	tss.esp0 = 0x00800000 - (pcb_loc[current_terminal]->pid + 1) * MAX_STACK;
-	asm volatile("					\n\
-			movl 	%0, %%ebp		\n\
-			movl 	%1, %%esp		\n\
-			movl	%2, %%cr3		\n\
-			"
-			:
-			: "r"(pcb_loc[current_terminal]->curr_ebp), "r"(pcb_loc[current_terminal]->curr_esp), "r"(pcb_loc[current_terminal]->curr_pd)
-			: "memory");  
-
 	return 0;
 }
 
@@ -727,16 +761,16 @@ void init_arrays()
 
 // this is because spec said so. 
 void keyboard_helper(void){
-	printk("\n\n\n\n      Okay, let me put it this way. You done messed up A-A-RON. \n\n");
-	printk("      You clearly, CLEARLY, state in the doc that at max, only four processes\n");
-	printk("      are supported on one terminal.\n");
-	printk("      But guess what? You didn't follow the doc. And now we're going to be\n");
-	printk("      penalized, for YOUR mistakes.\n\n");
-	printk("      Does that seem fair to you?\n\n");
-	printk("      I mean, why would you do this to us? WHY?!\n");
-	printk("      All we wanted, was to see our OS grow into something beautiful.\n");
-	printk("      But instead, it's going to page fault, and the worst part is,\n");
-	printk("      it's     N E V E R    E V E R    E V E R     going to recover.\n");
-	printk("\n      THANK YOU, AND HAVE A NICE DAY.\n\n\n");
+	printf("\n\n\n\n      Okay, let me put it this way. You done messed up A-A-RON. \n\n");
+	printf("      You clearly, CLEARLY, state in the doc that at max, only four processes\n");
+	printf("      are supported on one terminal.\n");
+	printf("      But guess what? You didn't follow the doc. And now we're going to be\n");
+	printf("      penalized, for YOUR mistakes.\n\n");
+	printf("      Does that seem fair to you?\n\n");
+	printf("      I mean, why would you do this to us? WHY?!\n");
+	printf("      All we wanted, was to see our OS grow into something beautiful.\n");
+	printf("      But instead, it's going to page fault, and the worst part is,\n");
+	printf("      it's     N E V E R    E V E R    E V E R     going to recover.\n");
+	printf("\n      THANK YOU, AND HAVE A NICE DAY.\n\n\n");
 }
 
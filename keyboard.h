@@ -77,6 +77,9 @@
 #define RSHIFTRELEASE 	0xB6
 
 #define SPACE			0x39
+#define EXTENDED		0xE0		// prefix of the grey keys
+#define PAGEUP			0x49		// after EXTENDED, alone it is keypad 9
+#define PAGEDOWN		0x51		// after EXTENDED, alone it is keypad 3
 #define F1				0x3B
 #define F2				0x3C
 #define F3				0x3D
@@ -104,6 +107,7 @@
 #define TERM_2			1
 #define TERM_3			2
 #define VID_MEM_SIZE	0x1000
+#define SCROLLBACK_PAGE	(NUM_ROWS - 1)	// rows Shift+PgUp/PgDn move, one kept for context
 #define VID_MEM 		0xB8000  
 #define B_BUF_1			0x09000000
 #define B_BUF_2			0x09100000
@@ -128,6 +132,10 @@ int32_t terminal_switch(int32_t term_num);
 /* Helper functions */
 void keyboard_helper(void);
 
+/* Displayed terminal, gets keyboard input */
 extern int32_t current_terminal;
 
+/* Terminal of the running program, gets its output */
+extern int32_t sched_terminal;
+
 #endif
@@ -0,0 +1,366 @@
+/**
+***	klog.c: Kernel log ring buffer. Messages are only copied in where
+***			they are logged and printed later by the klogd task.
+**/
+
+#include "klog.h"
+#include "lib.h"
+#include "pcb.h"
+#include "sched.h"
+#include "clock.h"
+#include "serial.h"
+
+/* Same scheme as the trace ring: a writer takes its slot with one xadd
+ * and sets klog_seq[slot] to the message's position plus one when it is
+ * done, so readers can skip messages half written or overwritten. */
+static klog_record_t klog_ring[KLOG_RECORDS];
+static volatile uint32_t klog_seq[KLOG_RECORDS];
+static volatile uint32_t klog_head = 0;		// position of the next message
+static uint32_t klog_printed = 0;			// next message klogd prints
+static uint32_t klog_first = 0;				// sys/dmesg starts here after a clear
+static uint32_t klog_console = KLOG_CONSOLE;
+static wait_queue_t klog_queue = WAIT_QUEUE_INIT;
+
+static const int8_t klog_level_char[KLOG_LEVELS] = {'E', 'W', 'I', 'D'};
+
+/*
+ * klog_puts
+ * Appends a string to a message being formatted
+ * INPUTS: out - message text
+ *		   len - bytes used so far, updated
+ *		   s - string to add
+ * OUTPUTS: none
+ * EFFECTS: stops at KLOG_TEXT
+ */
+static void klog_puts(int8_t* out, uint32_t* len, const int8_t* s)
+{
+	while (*s != '\0' && *len < KLOG_TEXT)
+	{
+		out[(*len)++] = *s++;
+	}
+}
+
+/*
+ * klog_format
+ * Formats a message like printf does
+ * INPUTS: out - KLOG_TEXT bytes
+ *		   format - printf format: %%, %x, %#x, %u, %d, %c and %s
+ *		   args - the arguments after format on the caller's stack
+ * OUTPUTS: bytes of text, not terminated
+ * EFFECTS: none
+ */
+static uint32_t klog_format(int8_t* out, int8_t* format, int32_t* args)
+{
+	int8_t conv[36];
+	uint32_t len = 0;
+	int32_t alternate, pad;
+
+	for (; *format != '\0'; format++)
+	{
+		if (*format != '%')
+		{
+			conv[0] = *format;
+			conv[1] = '\0';
+			klog_puts(out, &len, conv);
+			continue;
+		}
+
+		alternate = 0;
+		if (*++format == '#')
+		{
+			alternate = 1;
+			format++;
+		}
+		switch (*format)
+		{
+			case '\0':
+				return len;
+			case 'x':
+				itoa(*(uint32_t*)args++, conv, 16);
+				for (pad = 8 - strlen(conv); alternate && pad > 0; pad--)
+				{
+					klog_puts(out, &len, "0");
+				}
+				klog_puts(out, &len, conv);
+				break;
+			case 'u':
+				klog_puts(out, &len, itoa(*(uint32_t*)args++, conv, 10));
+				break;
+			case 'd':
+				if (*args < 0)
+				{
+					klog_puts(out, &len, "-");
+					klog_puts(out, &len, itoa(-*args++, conv, 10));
+				}
+				else
+				{
+					klog_puts(out, &len, itoa(*args++, conv, 10));
+				}
+				break;
+			case 'c':
+				conv[0] = (int8_t)*args++;
+				conv[1] = '\0';
+				klog_puts(out, &len, conv);
+				break;
+			case 's':
+				klog_puts(out, &len, *(int8_t**)args++);
+				break;
+			default:
+				conv[0] = *format;
+				conv[1] = '\0';
+				klog_puts(out, &len, conv);
+				break;
+		}
+	}
+	return len;
+}
+
+/*
+ * klog
+ * Logs a message
+ * INPUTS: level - KLOG_ERR to KLOG_DEBUG
+ *		   format - printf format, without a trailing newline
+ * OUTPUTS: none
+ * EFFECTS: Formats straight into the ring and wakes klogd. Takes no
+ *			lock, so it is fine in interrupt handlers and with
+ *			interrupts off.
+ */
+void klog(uint32_t level, int8_t* format, ...)
+{
+	klog_record_t* record;
+	int32_t* args = (void*)&format;
+	uint32_t pos = 1;
+
+	args++;
+	asm volatile("xaddl %0, %1"
+			: "+r"(pos), "+m"(klog_head)
+			:
+			: "memory", "cc");
+
+	klog_seq[pos & KLOG_MASK] = 0;
+	barrier();
+	record = &klog_ring[pos & KLOG_MASK];
+	record->tsc = rdtsc();
+	record->level = level < KLOG_LEVELS ? level : KLOG_DEBUG;
+	record->len = klog_format(record->text, format, args);
+	barrier();
+	klog_seq[pos & KLOG_MASK] = pos + 1;
+
+	wake_one(&klog_queue);
+}
+
+/*
+ * klog_copy
+ * Reads a message out of the ring
+ * INPUTS: pos - its position
+ *		   record - where the copy goes
+ * OUTPUTS: 0 on success, -1 if it is being written or was overwritten
+ * EFFECTS: Checks the sequence before and after copying, so a writer
+ *			that interrupts the copy is noticed.
+ */
+static int32_t klog_copy(uint32_t pos, klog_record_t* record)
+{
+	uint32_t slot = pos & KLOG_MASK;
+
+	if (klog_seq[slot] != pos + 1)
+	{
+		return -1;
+	}
+	barrier();
+	*record = klog_ring[slot];
+	barrier();
+	return klog_seq[slot] == pos + 1 ? 0 : -1;
+}
+
+/*
+ * klog_line
+ * Formats a message for printing
+ * INPUTS: record - the message
+ *		   out - at least KLOG_LINE_MAX bytes
+ * OUTPUTS: length of the line, not terminated
+ * EFFECTS: "[  sec.usec] L text\n" with the time since clock_init
+ */
+static uint32_t klog_line(const klog_record_t* record, int8_t* out)
+{
+	int8_t num[12];
+	uint32_t len = 0;
+	uint32_t sec, nsec, usec, i, n;
+
+	sec = div64_32(clock_tsc_to_ns(record->tsc), NSEC_PER_SEC, &nsec);
+	usec = nsec / 1000;
+
+	out[len++] = '[';
+	itoa(sec, num, 10);
+	for (n = strlen(num); n < 5; n++)
+	{
+		out[len++] = ' ';
+	}
+	for (i = 0; num[i] != '\0'; i++)
+	{
+		out[len++] = num[i];
+	}
+	out[len++] = '.';
+	for (i = 100000; i > 0; i /= 10)
+	{
+		out[len++] = '0' + (usec / i) % 10;
+	}
+	out[len++] = ']';
+	out[len++] = ' ';
+	out[len++] = klog_level_char[record->level];
+	out[len++] = ' ';
+	for (i = 0; i < record->len; i++)
+	{
+		out[len++] = record->text[i];
+	}
+	out[len++] = '\n';
+	return len;
+}
+
+/*
+ * klogd_main
+ * Body of the klogd task
+ * INPUTS: unused - task argument
+ * OUTPUTS: never returns
+ * EFFECTS: Sleeps until messages are logged, then prints each one to
+ *			COM1, and to the displayed terminal when its level is at
+ *			most klog_console. Printing happens here with interrupts
+ *			on, never in the code that logged the message.
+ */
+static void klogd_main(int32_t unused)
+{
+	klog_record_t record;
+	int8_t line[KLOG_LINE_MAX + 1];
+	uint32_t flags, len, lost, i;
+
+	while (1)
+	{
+		cli();
+		while (klog_printed == klog_head)
+		{
+			sleep_on(&klog_queue);
+		}
+		lost = 0;
+		if (klog_head - klog_printed > KLOG_RECORDS)
+		{
+			lost = klog_head - klog_printed - KLOG_RECORDS;
+			klog_printed = klog_head - KLOG_RECORDS;
+		}
+		sti();
+
+		if (lost != 0)
+		{
+			serial_puts("klog: messages lost\n");
+		}
+		if (klog_copy(klog_printed, &record) == 0)
+		{
+			len = klog_line(&record, line);
+			line[len] = '\0';
+			serial_puts(line);
+			if (record.level <= klog_console)
+			{
+				cli_and_save(flags);			// keyboard echo draws on the same terminal
+				for (i = 0; i < len; i++)
+				{
+					term_putc_to(current_terminal, line[i]);
+				}
+				restore_flags(flags);
+			}
+		}
+		klog_printed++;
+	}
+}
+
+/*
+ * klog_init
+ * Starts klogd
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Messages logged before this are printed once it first runs.
+ *			Must come after sched_init.
+ */
+void klog_init(void)
+{
+	if (sched_add_kthread(klogd_main) != 0)
+	{
+		printk("klogd not started, out of memory\n");
+	}
+}
+
+/*
+ * klog_read
+ * Reads the log, dmesg style
+ * INPUTS: fd - open sys/dmesg
+ *		   buf - where the lines go
+ *		   nbytes - at least KLOG_LINE_MAX
+ * OUTPUTS: bytes read, 0 once the newest message has been read, -1 on
+ *			a bad buffer
+ * EFFECTS: Returns whole lines only. file_pos is the position of the
+ *			next message, messages overwritten since are skipped.
+ */
+int32_t klog_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	fd_entry_t* entry = &pcb_loc[sched_terminal]->file_desc[fd];
+	klog_record_t record;
+	int8_t* out = buf;
+	int32_t len = 0;
+	uint32_t head = klog_head;
+	uint32_t pos = entry->file_pos;
+
+	if (buf == NULL || nbytes < KLOG_LINE_MAX)
+	{
+		return -1;
+	}
+
+	if ((int32_t)(klog_first - pos) > 0)
+	{
+		pos = klog_first;
+	}
+	if (head - pos > KLOG_RECORDS)
+	{
+		pos = head - KLOG_RECORDS;
+	}
+	while (pos != head && len + KLOG_LINE_MAX <= nbytes)
+	{
+		if (klog_copy(pos, &record) == 0)
+		{
+			len += klog_line(&record, &out[len]);
+		}
+		pos++;
+	}
+	entry->file_pos = pos;
+	return len;
+}
+
+/*
+ * klog_write
+ * Controls the log
+ * INPUTS: fd - open sys/dmesg
+ *		   buf - "clear", or a level digit for the screen
+ *		   nbytes - its length
+ * OUTPUTS: nbytes on success, -1 on an unknown command
+ * EFFECTS: clear only hides messages from sys/dmesg, klogd still
+ *			prints the ones it has not got to.
+ */
+int32_t klog_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	const int8_t* cmd = buf;
+
+	if (buf == NULL || nbytes < 1)
+	{
+		return -1;
+	}
+
+	if (nbytes >= 5 && strncmp(cmd, "clear", 5) == 0)
+	{
+		klog_first = klog_head;
+	}
+	else if (cmd[0] >= '0' && cmd[0] < '0' + KLOG_LEVELS)
+	{
+		klog_console = cmd[0] - '0';
+	}
+	else
+	{
+		return -1;
+	}
+	return nbytes;
+}
@@ -0,0 +1,41 @@
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+
+/* Log levels, lower is more severe */
+#define KLOG_ERR		0
+#define KLOG_WARN		1
+#define KLOG_INFO		2
+#define KLOG_DEBUG		3
+#define KLOG_LEVELS		4
+
+#define KLOG_RECORDS	256			// ring size, a power of two, the oldest messages are overwritten
+#define KLOG_MASK		(KLOG_RECORDS - 1)
+#define KLOG_TEXT		112			// longest message, longer ones are cut
+#define KLOG_LINE_MAX	(KLOG_TEXT + 24)	// "[sssss.uuuuuu] L " prefix and newline
+#define KLOG_CONSOLE	KLOG_WARN	// messages up to this level go to the screen
+
+/* One message, 128 bytes */
+typedef struct klog_record {
+	uint64_t tsc;					// when it was logged
+	uint8_t level;
+	uint8_t len;					// bytes of text used
+	uint16_t reserved;
+	uint32_t reserved2;
+	int8_t text[KLOG_TEXT];
+} klog_record_t;
+
+/* Logs a message, printf's conversions. Safe from interrupt handlers,
+ * it only copies into the ring and leaves printing to klogd. */
+void klog(uint32_t level, int8_t* format, ...);
+
+/* Starts klogd, which prints new messages to the screen and COM1 */
+void klog_init(void);
+
+/* sys/dmesg: reading returns the logged messages, writing "clear" hides
+ * the ones logged so far, a digit sets the screen's level */
+int32_t klog_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t klog_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
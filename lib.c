@@ -3,24 +3,182 @@
  */
 
 #include "lib.h"
+#include "serial.h"
 #define VIDEO 0xB8000
 #define NUM_COLS 80
 #define NUM_ROWS 25
 #define ATTRIB 0x7
-
+#define VGA_CHARS 0x4000				// the 32KB text buffer holds this many cells
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define CRTC_START_HI 0x0C				// cell shown at the top left, high byte
+#define CRTC_START_LO 0x0D
+#define VGA_VIEW (VGA_CHARS - NUM_COLS * NUM_ROWS)	// last screen of the buffer, shows scrollback
+
+static int log_serial = 0;			// set while printf runs, so kernel messages reach COM1
 static int screen_x[NUMTERMINALS];
 static int screen_y[NUMTERMINALS];
 static char* video_mem = (char *)VIDEO;
 
+/* Cell of the text buffer the CRTC shows at the top left. Scrolling the
+ * displayed terminal moves it down a row instead of copying the screen. */
+static uint32_t vga_origin = 0;
+
+/* Programs on each terminal drawing through vidmap, which always maps
+ * the start of the text buffer, so their terminal can't move vga_origin */
+static int vga_pins[NUMTERMINALS];
+
+/* Rows that scrolled off the top of each terminal, oldest overwritten
+ * first. sb_head counts every row pushed, so the newest is at
+ * (sb_head - 1) % SCROLLBACK_LINES. */
+static uint16_t sb_ring[NUMTERMINALS][SCROLLBACK_LINES][NUM_COLS];
+static uint32_t sb_head[NUMTERMINALS];
+
+/* Rows the displayed terminal is scrolled back, 0 when it is live */
+static uint32_t sb_view = 0;
+
+/*
+ *	void crtc_start(uint32_t cell);
+ *  	Inputs: cell - cell to show at the top left
+ *  	Return Value: none
+ *		Function: Points the CRTC at a cell of the text buffer.
+ */
+static void crtc_start(uint32_t cell)
+{
+	outb(CRTC_START_HI, CRTC_INDEX);
+	outb((cell >> 8) & 0xFF, CRTC_DATA);
+	outb(CRTC_START_LO, CRTC_INDEX);
+	outb(cell & 0xFF, CRTC_DATA);
+}
+
+/*
+ *	void vga_set_origin(uint32_t origin);
+ *  	Inputs: origin - cell to show at the top left
+ *  	Return Value: none
+ *		Function: Moves the displayed window, two register writes.
+ *				  Leaves scrollback, the live screen is shown again.
+ */
+static void vga_set_origin(uint32_t origin)
+{
+	vga_origin = origin;
+	sb_view = 0;
+	crtc_start(origin);
+}
+
+/*
+ *	void sb_live(void);
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Shows the live screen again if the displayed
+ *				  terminal is scrolled back, called before drawing on it.
+ */
+static void sb_live(void)
+{
+	if (sb_view != 0)
+	{
+		vga_set_origin(vga_origin);
+	}
+}
+
+/*
+ *	void sb_push(int terminal, char* row);
+ *  	Inputs: terminal - terminal scrolling
+ *				row - the row about to scroll off
+ *  	Return Value: none
+ *		Function: Keeps the row in the terminal's scrollback ring.
+ */
+static void sb_push(int terminal, char* row)
+{
+	memcpy(sb_ring[terminal][sb_head[terminal] % SCROLLBACK_LINES], row, NUM_COLS << 1);
+	sb_head[terminal]++;
+}
+
+/*
+ *	char* screen_mem(void);
+ *  	Inputs: void
+ *  	Return Value: first cell of the displayed window
+ *		Function: Where row 0 of the displayed terminal is.
+ */
+static char* screen_mem(void)
+{
+	return video_mem + (vga_origin << 1);
+}
+
+/*
+ *	void vga_reset(void);
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Moves the displayed screen back to the start of the
+ *				  text buffer, where terminal switches and vidmap expect
+ *				  it. One copy if the window had moved.
+ */
+void vga_reset(void)
+{
+	if (vga_origin != 0)
+	{
+		memmove(video_mem, screen_mem(), (NUM_COLS * NUM_ROWS) << 1);
+	}
+	vga_set_origin(0);
+}
+
+/*
+ *	void vga_pin(int terminal);
+ *  	Inputs: terminal - terminal of a program that called vidmap
+ *  	Return Value: none
+ *		Function: Keeps the terminal's screen at the start of the text
+ *				  buffer until vga_unpin, scrolling it by copying.
+ */
+void vga_pin(int terminal)
+{
+	vga_pins[terminal]++;
+	if (terminal == current_terminal)
+	{
+		vga_reset();
+	}
+}
+
+/*
+ *	void vga_unpin(int terminal);
+ *  	Inputs: terminal - terminal of a program that called vidmap
+ *  	Return Value: none
+ *		Function: Undoes a vga_pin when the program halts.
+ */
+void vga_unpin(int terminal)
+{
+	if (vga_pins[terminal] > 0)
+	{
+		vga_pins[terminal]--;
+	}
+}
+
+/*
+ *	char* term_mem(int terminal);
+ *  	Inputs: terminal - specific terminal to draw on
+ *  	Return Value: Video memory if the terminal is displayed,
+ *					  otherwise its background buffer.
+ *		Function: Lets programs on hidden terminals keep writing.
+ */
+static char* term_mem(int terminal)
+{
+	if (terminal == current_terminal)
+	{
+		sb_live();
+		return screen_mem();
+	}
+	return (char *)(B_BUF_1 + terminal * (B_BUF_2 - B_BUF_1));
+}
+
 /*
  *	void clear(void);
  *  	Inputs: void
  *  	Return Value: none
- *		Function: Clears all of video memory.
+ *		Function: Clears the screen and puts it back at the start of
+ *				  the text buffer.
  */
 void clear(void)
 {
     int32_t i;
+    vga_set_origin(0);
     for(i = 0; i < NUM_ROWS * NUM_COLS; i++)
     {
         *(uint8_t *)(video_mem + (i << 1)) = ' ';							// fills the entire screen with spaces
@@ -36,11 +194,14 @@ void clear(void)
  */
 void clearline(int x, int y)
 {
+    char* mem;
     int32_t i;
+    sb_live();
+    mem = screen_mem();
     for(i = 0; i < NUM_COLS; i++)
     {
-        *(uint8_t *)(video_mem + ((NUM_COLS * y + x + i) << 1)) = ' ';		// fills a line with spaces
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;					// set the line attribute
+        *(uint8_t *)(mem + ((NUM_COLS * y + x + i) << 1)) = ' ';			// fills a line with spaces
+        *(uint8_t *)(mem + ((NUM_COLS * y + x + i) << 1) + 1) = ATTRIB;	// set the line attribute
     }
 }
 
@@ -95,27 +256,114 @@ void setcoords(int x, int y, int terminal)
  *  	Inputs: terminal - specific terminal to scroll on
  *  	Return Value: none
  *		Function: Scrolls up one line when the bottom of the
- *				  terminal is reached.
+ *				  terminal is reached, saving the top row for scrollback.
+ *				  The displayed terminal scrolls by moving the CRTC
+ *				  window down a row through the text buffer and only
+ *				  copies once, back to the start, when the window reaches
+ *				  VGA_VIEW. Background buffers are one screen long and
+ *				  always shift.
  */
 void scroll(int terminal)
 {
-	static char* copy_video_mem = (char *)VIDEO;
+	char* mem = term_mem(terminal);
 	int32_t i;
-	for (i = 0; i < NUM_COLS * NUM_ROWS; i++) 
+
+	sb_push(terminal, mem);
+	if (terminal == current_terminal && vga_pins[terminal] == 0)
 	{
-    	*(uint8_t *)(copy_video_mem + (i << 1)) = *(uint8_t *)(video_mem + (i << 1));						// copies video memory into a temporary buffer
-    	*(uint8_t *)(copy_video_mem + (i << 1) + 1) = *(uint8_t *)(video_mem + (i << 1) + 1);				// copies attributes
-    }
-    for (i = 0; i < NUM_COLS * NUM_ROWS; i++) 
+		if (vga_origin + NUM_COLS * (NUM_ROWS + 1) <= VGA_VIEW)
+		{
+			vga_set_origin(vga_origin + NUM_COLS);							// the old bottom row's successor becomes visible
+		}
+		else
+		{
+			memcpy(video_mem, mem + (NUM_COLS << 1), (NUM_COLS * (NUM_ROWS - 1)) << 1);	// out of buffer, wrap to the start
+			vga_set_origin(0);
+		}
+		mem = screen_mem();
+	}
+	else
+	{
+		memmove(mem, mem + (NUM_COLS << 1), (NUM_COLS * (NUM_ROWS - 1)) << 1);	// shift every line up
+	}
+	for (i = NUM_COLS * (NUM_ROWS - 1); i < NUM_COLS * NUM_ROWS; i++) 
 	{
-    	*(uint8_t *)(video_mem + (i << 1)) = *(uint8_t *)(copy_video_mem + ((i + NUM_COLS) << 1));			// recopies back into video memory after everything has been shifted up
-    	*(uint8_t *)(video_mem + (i << 1) + 1) = *(uint8_t *)(copy_video_mem + ((i + NUM_COLS) << 1) + 1);	// same with attributes
+    	*(uint8_t *)(mem + (i << 1)) = ' ';										// blank the bottom line
+    	*(uint8_t *)(mem + (i << 1) + 1) = ATTRIB;
     }
 
     screen_x[terminal] = 0;						// resets screen_x
     screen_y[terminal] = NUM_ROWS - 1;			// sets screen_y to the bottom because scrolling just occured so the coordinates must be on the last line
 }
 
+/*
+ *	void scrollback(int terminal, int32_t rows);
+ *  	Inputs: terminal - terminal to page through, only the displayed one moves
+ *				rows - how far to go back, negative goes forward
+ *  	Return Value: none
+ *		Function: Shows older output. The view is built in the last
+ *				  screen of the text buffer with one row copy per line,
+ *				  from the ring and then from the top of the live screen,
+ *				  and the CRTC is pointed at it, so the live screen is
+ *				  untouched. Going forward past the newest row, or any
+ *				  output to the terminal, shows the live screen again.
+ */
+void scrollback(int terminal, int32_t rows)
+{
+	uint32_t history, row, line;
+	int32_t view;
+	char* src;
+	char* dst = video_mem + (VGA_VIEW << 1);
+
+	if (terminal != current_terminal)
+	{
+		return;
+	}
+
+	history = sb_head[terminal] < SCROLLBACK_LINES ? sb_head[terminal] : SCROLLBACK_LINES;
+	view = (int32_t)sb_view + rows;
+	if (view > (int32_t)history)
+	{
+		view = history;
+	}
+	if (view <= 0)
+	{
+		sb_live();
+		return;
+	}
+
+	for (row = 0; row < NUM_ROWS; row++)
+	{
+		line = history - view + row;				// ring rows first, then the live screen's
+		if (line < history)
+		{
+			src = (char *)sb_ring[terminal][(sb_head[terminal] - history + line) % SCROLLBACK_LINES];
+		}
+		else
+		{
+			src = screen_mem() + (((line - history) * NUM_COLS) << 1);
+		}
+		memcpy(dst + ((row * NUM_COLS) << 1), src, NUM_COLS << 1);
+	}
+	sb_view = view;
+	crtc_start(VGA_VIEW);
+}
+
+/*
+* void log_putc(uint8_t c);
+*   Inputs: uint_8 c = character to send
+*   Return Value: void
+*	Function: Copies kernel output to the serial console, with
+*	          CR LF line ends for terminals.
+*/
+
+static void log_putc(uint8_t c)
+{
+	if(c == '\n')
+		serial_putc('\r');
+	serial_putc(c);
+}
+
 /*
 * int32_t printk(int8_t* s);
 *   Inputs: int_8* s = pointer to a string of characters
@@ -129,6 +377,7 @@ int32_t printk(int8_t* s)
 	while(s[index] != '\0')
 	{
 		term_putc(s[index]);
+		log_putc(s[index]);
 		index++;
 	}
 
@@ -136,29 +385,44 @@ int32_t printk(int8_t* s)
 }
 
 /*
- *	void term_put(uint8_t c);
+ *	void term_putc(uint8_t c);
  *  	Inputs: c - character to print
  *  	Return Value: none
- *		Function: Outputs a character to the console.
- *				  Used in keyboard handler and terminal syscalls.
+ *		Function: Outputs a character to the running program's terminal.
+ *				  Used in terminal syscalls and printk.
  */
 void term_putc(uint8_t c)
 {
+	term_putc_to(sched_terminal, c);
+}
+
+/*
+ *	void term_putc_to(int terminal, uint8_t c);
+ *  	Inputs: terminal - specific terminal to print on
+ *				c - character to print
+ *  	Return Value: none
+ *		Function: Outputs a character to a terminal, on screen if it is
+ *				  displayed and to its background buffer if not.
+ */
+void term_putc_to(int terminal, uint8_t c)
+{
+	char* mem = term_mem(terminal);
+
     if(c == '\n' || c == '\r')
     {
-        setcoords(0, getycoord(current_terminal) + 1, current_terminal);													// increments screen_y and lets setcoords handle scrolling if necessary
+        setcoords(0, getycoord(terminal) + 1, terminal);													// increments screen_y and lets setcoords handle scrolling if necessary
     } 
     else 
     {
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1)) = c;			// puts character to screen
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1) + 1) = ATTRIB;	// sets line attribute
-        screen_x[current_terminal]++;
-        if (screen_x[current_terminal] == NUM_COLS)
+        *(uint8_t *)(mem + ((NUM_COLS*screen_y[terminal] + screen_x[terminal]) << 1)) = c;				// puts character to screen
+        *(uint8_t *)(mem + ((NUM_COLS*screen_y[terminal] + screen_x[terminal]) << 1) + 1) = ATTRIB;		// sets line attribute
+        screen_x[terminal]++;
+        if (screen_x[terminal] == NUM_COLS)
         {
-        	setcoords(0, getycoord(current_terminal) + 1, current_terminal);												// increments screen_y and lets setcoords handle scrolling if necessary
+        	setcoords(0, getycoord(terminal) + 1, terminal);												// increments screen_y and lets setcoords handle scrolling if necessary
         }
-        screen_x[current_terminal] %= NUM_COLS;
-        screen_y[current_terminal] = (screen_y[current_terminal] + (screen_x[current_terminal] / NUM_COLS)) % NUM_ROWS;
+        screen_x[terminal] %= NUM_COLS;
+        screen_y[terminal] = (screen_y[terminal] + (screen_x[terminal] / NUM_COLS)) % NUM_ROWS;
     }
 }
 
@@ -190,7 +454,9 @@ printf(int8_t *format, ...)
 
 	/* Stack pointer for the other parameters */
 	int32_t* esp = (void *)&format;
+	int log_was = log_serial;
 	esp++;
+	log_serial = 1;
 
 	while(*buf != '\0') {
 		switch(*buf) {
@@ -290,6 +556,7 @@ format_char_switch:
 		buf++;
 	}
 
+	log_serial = log_was;
 	return (buf - format);
 }
 
@@ -322,12 +589,15 @@ puts(int8_t* s)
 void
 putc(uint8_t c)
 {
+    if(log_serial)
+        log_putc(c);
+    sb_live();
     if(c == '\n' || c == '\r') {
         screen_y[current_terminal]++;
         screen_x[current_terminal]=0;
     } else {
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1) + 1) = ATTRIB;
+        *(uint8_t *)(screen_mem() + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1)) = c;
+        *(uint8_t *)(screen_mem() + ((NUM_COLS*screen_y[current_terminal] + screen_x[current_terminal]) << 1) + 1) = ATTRIB;
         screen_x[current_terminal]++;
         screen_x[current_terminal] %= NUM_COLS;
         screen_y[current_terminal] = (screen_y[current_terminal] + (screen_x[current_terminal] / NUM_COLS)) % NUM_ROWS;
@@ -432,18 +702,20 @@ strlen(const int8_t* s)
 void*
 memset(void* s, int32_t c, uint32_t n)
 {
+	void* d = s;
+
 	c &= 0xFF;
 	asm volatile("                  \n\
-			.memset_top:            \n\
+			1:                      \n\
 			testl   %%ecx, %%ecx    \n\
-			jz      .memset_done    \n\
+			jz      4f              \n\
 			testl   $0x3, %%edi     \n\
-			jz      .memset_aligned \n\
+			jz      2f              \n\
 			movb    %%al, (%%edi)   \n\
 			addl    $1, %%edi       \n\
 			subl    $1, %%ecx       \n\
-			jmp     .memset_top     \n\
-			.memset_aligned:        \n\
+			jmp     1b              \n\
+			2:                      \n\
 			movw    %%ds, %%dx      \n\
 			movw    %%dx, %%es      \n\
 			movl    %%ecx, %%edx    \n\
@@ -451,17 +723,17 @@ memset(void* s, int32_t c, uint32_t n)
 			andl    $0x3, %%edx     \n\
 			cld                     \n\
 			rep     stosl           \n\
-			.memset_bottom:         \n\
+			3:                      \n\
 			testl   %%edx, %%edx    \n\
-			jz      .memset_done    \n\
+			jz      4f              \n\
 			movb    %%al, (%%edi)   \n\
 			addl    $1, %%edi       \n\
 			subl    $1, %%edx       \n\
-			jmp     .memset_bottom  \n\
-			.memset_done:           \n\
+			jmp     3b              \n\
+			4:                      \n\
 			"
-			:
-			: "a"(c << 24 | c << 16 | c << 8 | c), "D"(s), "c"(n)
+			: "+D"(d), "+c"(n)
+			: "a"(c << 24 | c << 16 | c << 8 | c)
 			: "edx", "memory", "cc"
 			);
 
@@ -481,14 +753,16 @@ memset(void* s, int32_t c, uint32_t n)
 void*
 memset_word(void* s, int32_t c, uint32_t n)
 {
+	void* d = s;
+
 	asm volatile("                  \n\
 			movw    %%ds, %%dx      \n\
 			movw    %%dx, %%es      \n\
 			cld                     \n\
 			rep     stosw           \n\
 			"
-			:
-			: "a"(c), "D"(s), "c"(n)
+			: "+D"(d), "+c"(n)
+			: "a"(c)
 			: "edx", "memory", "cc"
 			);
 
@@ -507,14 +781,16 @@ memset_word(void* s, int32_t c, uint32_t n)
 void*
 memset_dword(void* s, int32_t c, uint32_t n)
 {
+	void* d = s;
+
 	asm volatile("                  \n\
 			movw    %%ds, %%dx      \n\
 			movw    %%dx, %%es      \n\
 			cld                     \n\
 			rep     stosl           \n\
 			"
-			:
-			: "a"(c), "D"(s), "c"(n)
+			: "+D"(d), "+c"(n)
+			: "a"(c)
 			: "edx", "memory", "cc"
 			);
 
@@ -533,19 +809,21 @@ memset_dword(void* s, int32_t c, uint32_t n)
 void*
 memcpy(void* dest, const void* src, uint32_t n)
 {
+	void* d = dest;
+
 	asm volatile("                  \n\
-			.memcpy_top:            \n\
+			1:                      \n\
 			testl   %%ecx, %%ecx    \n\
-			jz      .memcpy_done    \n\
+			jz      4f              \n\
 			testl   $0x3, %%edi     \n\
-			jz      .memcpy_aligned \n\
+			jz      2f              \n\
 			movb    (%%esi), %%al   \n\
 			movb    %%al, (%%edi)   \n\
 			addl    $1, %%edi       \n\
 			addl    $1, %%esi       \n\
 			subl    $1, %%ecx       \n\
-			jmp     .memcpy_top     \n\
-			.memcpy_aligned:        \n\
+			jmp     1b              \n\
+			2:                      \n\
 			movw    %%ds, %%dx      \n\
 			movw    %%dx, %%es      \n\
 			movl    %%ecx, %%edx    \n\
@@ -553,19 +831,19 @@ memcpy(void* dest, const void* src, uint32_t n)
 			andl    $0x3, %%edx     \n\
 			cld                     \n\
 			rep     movsl           \n\
-			.memcpy_bottom:         \n\
+			3:                      \n\
 			testl   %%edx, %%edx    \n\
-			jz      .memcpy_done    \n\
+			jz      4f              \n\
 			movb    (%%esi), %%al   \n\
 			movb    %%al, (%%edi)   \n\
 			addl    $1, %%edi       \n\
 			addl    $1, %%esi       \n\
 			subl    $1, %%edx       \n\
-			jmp     .memcpy_bottom  \n\
-			.memcpy_done:           \n\
+			jmp     3b              \n\
+			4:                      \n\
 			"
+			: "+S"(src), "+D"(d), "+c"(n)
 			:
-			: "S"(src), "D"(dest), "c"(n)
 			: "eax", "edx", "memory", "cc"
 			);
 
@@ -585,20 +863,23 @@ memcpy(void* dest, const void* src, uint32_t n)
 void*
 memmove(void* dest, const void* src, uint32_t n)
 {
+	void* d = dest;
+
 	asm volatile("                  \n\
 			movw    %%ds, %%dx      \n\
 			movw    %%dx, %%es      \n\
 			cld                     \n\
 			cmp     %%edi, %%esi    \n\
-			jae     .memmove_go     \n\
+			jae     1f              \n\
 			leal    -1(%%esi, %%ecx), %%esi    \n\
 			leal    -1(%%edi, %%ecx), %%edi    \n\
 			std                     \n\
-			.memmove_go:            \n\
+			1:                      \n\
 			rep     movsb           \n\
+			cld                     \n\
 			"
+			: "+D"(d), "+S"(src), "+c"(n)
 			:
-			: "D"(dest), "S"(src), "c"(n)
 			: "edx", "memory", "cc"
 			);
 
@@ -698,6 +979,6 @@ test_interrupts(void)
 {
 	int32_t i;
 	for (i=0; i < NUM_ROWS*NUM_COLS; i++) {
-		video_mem[i<<1]++;
+		screen_mem()[i<<1]++;
 	}
 }
@@ -8,6 +8,11 @@
 #include "types.h"
 #include "keyboard.h"
 
+/* Rows each terminal keeps after they scroll off, 160 bytes a row */
+#ifndef SCROLLBACK_LINES
+#define SCROLLBACK_LINES 200
+#endif
+
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
 int32_t puts(int8_t *s);
@@ -20,8 +25,13 @@ int getxcoord(int terminal);
 int getycoord(int terminal);
 void setcoords(int x, int y, int terminal);
 void scroll(int terminal);
+void vga_reset(void);
+void vga_pin(int terminal);
+void vga_unpin(int terminal);
+void scrollback(int terminal, int32_t rows);
 int32_t printk(int8_t* s);
 void term_putc(uint8_t c);
+void term_putc_to(int terminal, uint8_t c);
 
 
 void* memset(void* s, int32_t c, uint32_t n);
@@ -80,6 +90,52 @@ static inline uint32_t inl(port)
 	return val;
 }
 
+/* Reads the time-stamp counter */
+static inline uint64_t rdtsc(void)
+{
+	uint64_t val;
+	asm volatile("rdtsc"
+			: "=A"(val)
+			:
+			: "memory" );
+	return val;
+}
+
+/* Keeps the compiler from moving memory accesses across this point */
+#define barrier() asm volatile("" : : : "memory")
+
+/* Divides a 64 bit value by a 32 bit one with a single divl, so no
+ * libgcc helper is needed. The quotient must fit in 32 bits */
+static inline uint32_t div64_32(uint64_t n, uint32_t d, uint32_t* rem)
+{
+	uint32_t q, r;
+	asm("divl %4"
+			: "=a"(q), "=d"(r)
+			: "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d)
+			: "cc" );
+	if (rem != NULL)
+		*rem = r;
+	return q;
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr"
+			:
+			: "c"(msr), "A"(val)
+			: "memory" );
+}
+
+/* Executes CPUID for the given leaf and returns all four registers */
+static inline void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d)
+{
+	asm volatile("cpuid"
+			: "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+			: "a"(leaf)
+			: "memory" );
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
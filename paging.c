@@ -5,22 +5,61 @@
 **/
 
 #include "paging.h"
+#include "filesys.h"
+
+/* Paging structures for each program, indexed by pid, NULL when free */
+static prog_space_t* prog_space[MAX_PROCESSES];
+
+/* Virtual address of each terminal's background buffer */
+static const uint32_t term_buf[NUMTERMINALS] = {B_BUF_1, B_BUF_2, B_BUF_3};
+
+/* Frame behind each terminal's background buffer */
+static uint32_t term_frame[NUMTERMINALS];
+
+/* Set once global pages are turned on in cr4 */
+static uint32_t pge_enabled = 0;
+
+/* Executable backing each program's image, indexed by pid. Each program
+	keeps its own copy, valid is clear when it has none. */
+static elf_image_t prog_image[MAX_PROCESSES];
 
 /**
 ***	Paging Functions:
 **/
 
+/* 
+ * time_pte
+ * Builds the page table entry for the time page
+ * INPUTS: none
+ * OUTPUTS: user, read-only entry for time_page's frame
+ * EFFECTS: none
+ */
+static uint32_t time_pte(void)
+{
+	uint32_t val = (uint32_t)time_page;
+
+	val = val & ADDR_MASK;
+	val = val | PRESENT_BIT;			// no RW_BIT, programs only read it
+	val = val | USER_BIT;
+	return val;
+}
+
 /*
  *	void paging_init();
  *  	Inputs: none
  *   	Return Value: none
  *		Function: Initializes paging. Sets up the page table and the page directory.
+ *				  Builds the kernel entries every program's page directory
+ *				  copies: low memory, the kernel page, a direct map of the
+ *				  frames below 128MB and the terminal buffers, whose frames
+ *				  come from the frame allocator.
  *				  Enables paging and extended paging.
  *				  Updates CR3 with the address of the page directory.
  */
 void paging_init()
 {
 	uint32_t i;
+	uint32_t frame;
 	uint32_t val = (uint32_t)page_table;
 
 	val = val &	ADDR_MASK;
@@ -31,7 +70,7 @@ void paging_init()
 	val = 0;
 	for(i = 0; i < TABLE_SIZE; i++) 	// setup first table from 0-4MB
 	{									
-		page_table[i] = val | PRWS_BIT; // sets present and super
+		page_table[i] = val | PRWS_BIT | GLOBAL_BIT; // sets present, super and global
 		val += PAGE_SIZE;				// 0-4MB should be reserved for kernel
 	}
 
@@ -42,12 +81,15 @@ void paging_init()
 	val = val | GLOBAL_BIT; 			// global
 	page_directory[1] = val;
 
-	val = _8MB; 						// Initial page setup for first user program
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	page_directory[_128PDENTRY] = val; 
+	for (i = 2; i < _128PDENTRY; i++)	// 8MB-128MB maps onto itself so the kernel
+	{									// can reach any frame it allocates
+		val = i * _4MB;
+		val = val | PRESENT_BIT;
+		val = val | RW_BIT;
+		val = val | SIZE_BIT;
+		val = val | GLOBAL_BIT;
+		page_directory[i] = val;
+	}
 
 	page_table[0] = 0;					// initial page value should be NULL
 
@@ -58,6 +100,14 @@ void paging_init()
 	val = val | USER_BIT;
 	vid_table[0] = val;
 
+	frame = frame_alloc();				// time page, filled in by clock.c
+	if (frame != 0)
+	{
+		memset((void*)frame, 0, PAGE_SIZE);
+		time_page = (time_page_t*)frame;
+		vid_table[TIME_PAGE_INDEX] = time_pte();
+	}
+
 	val = (uint32_t)vid_table;			// We assigned 136MB to be user vid mem
 	val = val & ADDR_MASK;
 	val = val | PRESENT_BIT;
@@ -65,6 +115,30 @@ void paging_init()
 	val = val | USER_BIT;
 	page_directory[_136PDENTRY] = val;
 
+	memset(term_table, 0, sizeof(term_table));
+	for (i = 0; i < NUMTERMINALS; i++)	// one frame per background buffer
+	{									// The virtual address is set to 144MB
+		frame = frame_alloc();
+		if (frame == 0)
+		{
+			continue;
+		}
+		memset((void*)frame, 0, PAGE_SIZE);		// paging is still off
+		term_frame[i] = frame;
+		val = frame;
+		val = val & ADDR_MASK;
+		val = val | PRESENT_BIT;
+		val = val | RW_BIT;
+		val = val | GLOBAL_BIT;			// kernel only, same in every program
+		term_table[(term_buf[i] - B_BUF_1) / PAGE_SIZE] = val;
+	}
+
+	val = (uint32_t)term_table;
+	val = val & ADDR_MASK;
+	val = val | PRESENT_BIT;
+	val = val | RW_BIT;
+	page_directory[_144PDENTRY] = val;
+
 	asm volatile("mov %0, %%cr3":: "b"(page_directory));	// moves page directory address into the cr3 register
 	
 	uint32_t cr4;											// enables 4MB pages by toggling bit 4 in cr4
@@ -75,407 +149,374 @@ void paging_init()
 	uint32_t cr0;											//enables paging by toggling bit 31 in cr0
 	asm volatile("mov %%cr0, %0": "=b"(cr0));
 	cr0 |= cr0_ENABLE;
+	cr0 |= cr0_WP;											// kernel writes to mapped program text must fault too
 	asm volatile("mov %0, %%cr0":: "b"(cr0));
-}
 
+	uint32_t a, b, c, d;									// keep kernel TLB entries across cr3 reloads
+	cpuid(CPUID_FEATURES, &a, &b, &c, &d);
+	if (d & CPUID_PGE)
+	{
+		cr4 |= cr4_PGE;
+		asm volatile("mov %0, %%cr4":: "b"(cr4));
+		pge_enabled = 1;
+	}
+}
 
-/* 
- * prog1_init
- * Adds a page of program mem of 4MB to physical address
- * and map it to virtual address 128MB
- * INPUTS: physical_address
- * OUTPUTS: none
- * EFFECTS: page specified by physical address gets mapped to 128MB
- * 			Note that all following prog#_init() functions are exact 
- *  		copies of this function except each has its own distinct
- *			page directory and page tables. 
+/*
+ *	void kernel_remap(uint32_t* table, uint32_t index, uint32_t val, uint32_t vaddr);
+ *  	Inputs: table - page table holding the entry
+ *				index - entry to change
+ *				val - new entry
+ *				vaddr - virtual address the entry maps
+ *   	Return Value: none
+ *		Function: Changes a mapping that may be cached in the TLB and
+ *				  flushes only that page. Kernel mappings are global, so
+ *				  reloading cr3 would not drop them anyway. The vidmap
+ *				  page and the syscall benchmark page change through here.
  */
-void prog1_init()
+void kernel_remap(uint32_t* table, uint32_t index, uint32_t val, uint32_t vaddr)
 {
- 	uint32_t val = (uint32_t)prog1_pt;
-	val = val &	ADDR_MASK;
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog1_pd[0] = val;
-
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog1_pd[1]= val;
+	table[index] = val;
+	invlpg(vaddr);
+}
 
-	val = 0;
+/*
+ *	void tlb_bench(void);
+ *  	Inputs: none
+ *   	Return Value: none
+ *		Function: Context-switch TLB proxy. Reloads cr3 and then touches
+ *				  TLB_BENCH_PAGES kernel 4KB pages, the way a switch is
+ *				  followed by kernel work. Prints the average cycles with
+ *				  global pages off and on.
+ */
+void tlb_bench(void)
+{
+	uint32_t flags;
+	uint32_t cr3;
+	uint32_t cr4;
+	uint32_t pass;
 	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
-	{
-		prog1_pt[i] = val|PRWS_BIT; 	// sets present and super
-		val+=PAGE_SIZE;
-	}
-
-	val = _8MB + _4MB * 0; 				// Note that for each subsequent user page,
-	val = val | PRESENT_BIT; 			// we must increment the physical mapping
-	val = val | RW_BIT; 				// by 4MB 
-	val = val | SIZE_BIT; 				 
-	val = val | USER_BIT; 				 
-	prog1_pd[_128PDENTRY] = val; 
-	prog1_pt[0] = 0;					// initial page value should be null
+	uint32_t j;
+	uint32_t cycles[2];
+	uint64_t start;
+	volatile uint32_t sink = 0;
 
-	val = VIDMEM;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog1_vt[0] = val;
-
-	val = (uint32_t)prog1_vt;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog1_pd[_136PDENTRY] = val;
+	cli_and_save(flags);
+	asm volatile("mov %%cr3, %0": "=b"(cr3));
+	asm volatile("mov %%cr4, %0": "=b"(cr4));
 
-	val = _16MB + _16MB;				// Memory mapping for video buffers is 
-	for (i = 0; i < TABLE_SIZE; i++)	// set at 32MB 
-	{									// The virtual address is set to 144MB
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog1_term[i] = val;
-		val += PAGE_SIZE;
+	for (pass = 0; pass < 2; pass++)
+	{
+		if (pass == 0)										// toggling PGE also flushes global entries
+		{
+			asm volatile("mov %0, %%cr4":: "b"(cr4 & ~cr4_PGE));
+		}
+		else
+		{
+			asm volatile("mov %0, %%cr4":: "b"(cr4));
+		}
+
+		start = rdtsc();
+		for (i = 0; i < TLB_BENCH_ITERS; i++)
+		{
+			asm volatile("mov %0, %%cr3":: "b"(cr3) : "memory");
+			for (j = 1; j <= TLB_BENCH_PAGES; j++)			// page 0 is left unmapped
+			{
+				sink += *(volatile uint32_t*)(j * PAGE_SIZE);
+			}
+		}
+		cycles[pass] = (uint32_t)(rdtsc() - start) / TLB_BENCH_ITERS;
 	}
 
-	val = (uint32_t)prog1_term;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	prog1_pd[_144PDENTRY] = val;
-
-	asm volatile("mov %0, %%cr3":: "b"(prog1_pd)); 	//moves page_directory address into the cr3 register
+	restore_flags(flags);
+	printf("cr3 reload + %u page touches: %u cycles without global pages, %u with (PGE %s)\n",
+		TLB_BENCH_PAGES, cycles[0], cycles[1], pge_enabled ? "on" : "unsupported");
 }
 
-void prog2_init()
+
+/* 
+ * prog_init
+ * Builds the address space for a program
+ * INPUTS: pid - process to build the address space for
+ * OUTPUTS: 0 on success, -1 if there are no frames for its page tables
+ * EFFECTS: The page directory and tables come from the frame allocator.
+ *			Kernel entries are copied from the boot page directory, the
+ *			program page at 128MB gets an empty 4KB table whose frames
+ *			page_in allocates on first touch. cr3 is left alone so the
+ *			caller can still read the parent's memory.
+ */
+int32_t prog_init(uint32_t pid)
 {
- 	uint32_t val = (uint32_t)prog2_pt;
-	val = val &	ADDR_MASK;
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog2_pd[0] = val;
+	prog_space_t* space;
+	uint32_t val;
 
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog2_pd[1]= val;
+	if (pid >= MAX_PROCESSES)
+	{
+		return -1;
+	}
 
-	val = 0;
-	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
+	space = (prog_space_t*)frame_alloc_contig(PROG_FRAMES);
+	if (space == NULL)
 	{
-		prog2_pt[i] = val|PRWS_BIT; 	// sets present and super
-		val+=PAGE_SIZE;
+		return -1;
 	}
+	memset(space, 0, sizeof(prog_space_t));
+	prog_space[pid] = space;
+	prog_image[pid].valid = 0;
 
-	val = _8MB + _4MB * 1; 
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	prog2_pd[_128PDENTRY] = val; 
-	prog2_pt[0] = 0;					// initial page value should be null
+	memcpy(space->pd, page_directory, _128PDENTRY * sizeof(uint32_t));	// kernel and direct map
+	space->pd[_144PDENTRY] = page_directory[_144PDENTRY];				// terminal buffers
 
-	val = VIDMEM;
+	val = (uint32_t)space->ut;
 	val = val & ADDR_MASK;
 	val = val | PRESENT_BIT;
 	val = val | RW_BIT;
 	val = val | USER_BIT;
-	prog2_vt[0] = val;
+	space->pd[_128PDENTRY] = val;
 
-	val = (uint32_t)prog2_vt;
+	val = (uint32_t)space->vt;
 	val = val & ADDR_MASK;
 	val = val | PRESENT_BIT;
 	val = val | RW_BIT;
 	val = val | USER_BIT;
-	prog2_pd[_136PDENTRY] = val;
-
-	val = _16MB + _16MB;
-	for (i = 0; i < TABLE_SIZE; i++)
-	{
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog2_term[i] = val;
-		val += PAGE_SIZE;
-	}
+	space->pd[_136PDENTRY] = val;										// vidmap
 
-	val = (uint32_t)prog2_term;
+	val = VIDMEM;
 	val = val & ADDR_MASK;
 	val = val | PRESENT_BIT;
 	val = val | RW_BIT;
-	prog2_pd[_144PDENTRY] = val;
+	val = val | USER_BIT;
+	space->vt[0] = val;
+
+	if (time_page != NULL)
+	{
+		space->vt[TIME_PAGE_INDEX] = time_pte();
+	}
 
-	asm volatile("mov %0, %%cr3":: "b"(prog2_pd));	//moves page_directory address into the cr3 register
+	return 0;
 }
 
-void prog3_init()
+/* 
+ * prog_load
+ * Switches to a program's address space
+ * INPUTS: pid - process built by prog_init
+ * OUTPUTS: none
+ * EFFECTS: The program's page directory is loaded into cr3.
+ */
+void prog_load(uint32_t pid)
 {
- 	uint32_t val = (uint32_t)prog3_pt;
-	val = val &	ADDR_MASK;
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog3_pd[0] = val;
-
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog3_pd[1]= val;
-
-	val = 0;
-	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
+	if (pid >= MAX_PROCESSES || prog_space[pid] == NULL)
 	{
-		prog3_pt[i] = val|PRWS_BIT; // sets present and super
-		val+=PAGE_SIZE;
+		return;
 	}
 
-	val = _8MB + _4MB * 2;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	prog3_pd[_128PDENTRY] = val; 
-	prog3_pt[0] = 0;					// initial page value should be null
-
-	val = VIDMEM;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog3_vt[0] = val;
+	asm volatile("mov %0, %%cr3":: "b"(prog_space[pid]->pd)); 	//moves page_directory address into the cr3 register
+}
 
-	val = (uint32_t)prog3_vt;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog3_pd[_136PDENTRY] = val;
+/* 
+ * prog_vidmap
+ * Picks what a program's vidmap page shows
+ * INPUTS: pid - process to update
+ *		   terminal - terminal the program runs on
+ * OUTPUTS: none
+ * EFFECTS: Maps the real screen when the terminal is displayed,
+ *			otherwise the terminal's background buffer, so programs on
+ *			hidden terminals keep drawing without touching the screen.
+ *			Only the loaded directory can hold a stale translation, the
+ *			others are flushed by their next cr3 load.
+ */
+void prog_vidmap(uint32_t pid, int32_t terminal)
+{
+	uint32_t val;
 
-	val = _16MB + _16MB;
-	for (i = 0; i < TABLE_SIZE; i++)
+	if (pid >= MAX_PROCESSES || prog_space[pid] == NULL || terminal < 0 || terminal >= NUMTERMINALS)
 	{
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog3_term[i] = val;
-		val += PAGE_SIZE;
+		return;
 	}
 
-	val = (uint32_t)prog3_term;
+	val = (terminal == current_terminal) ? VIDMEM : term_frame[terminal];
 	val = val & ADDR_MASK;
 	val = val | PRESENT_BIT;
 	val = val | RW_BIT;
-	prog3_pd[_144PDENTRY] = val;
-
-	asm volatile("mov %0, %%cr3":: "b"(prog3_pd));	//moves page_directory address into the cr3 register
+	val = val | USER_BIT;
+	kernel_remap(prog_space[pid]->vt, 0, val, MB136);
 }
 
-void prog4_init()
+/* 
+ * prog_free
+ * Gives a finished program's memory back to the frame allocator
+ * INPUTS: pid - process that has halted
+ * OUTPUTS: none
+ * EFFECTS: Frees every page the program faulted in, except filesystem
+ *			blocks it mapped read-only, then its page tables. Its page
+ *			directory must no longer be loaded in cr3.
+ */
+void prog_free(uint32_t pid)
 {
- 	uint32_t val = (uint32_t)prog4_pt;
-	val = val &	ADDR_MASK;
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog4_pd[0] = val;
-
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog4_pd[1]= val;
-
-	val = 0;
+	prog_space_t* space;
 	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
+
+	if (pid >= MAX_PROCESSES || prog_space[pid] == NULL)
 	{
-		prog4_pt[i] = val|PRWS_BIT; 	// sets present and super
-		val+=PAGE_SIZE;
+		return;
 	}
 
-	val = _8MB + _4MB * 3; 
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	prog4_pd[_128PDENTRY] = val; 
-	prog4_pt[0] = 0;					// initial page value should be null
-
-	val = VIDMEM;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog4_vt[0] = val;
-
-	val = (uint32_t)prog4_vt;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog4_pd[_136PDENTRY] = val;
-
-	val = _16MB + _16MB;
+	space = prog_space[pid];
 	for (i = 0; i < TABLE_SIZE; i++)
 	{
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog4_term[i] = val;
-		val += PAGE_SIZE;
+		if ((space->ut[i] & PRESENT_BIT) && !(space->ut[i] & FSMAP_BIT))
+		{
+			frame_free(space->ut[i] & ADDR_MASK);
+		}
 	}
 
-	val = (uint32_t)prog4_term;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	prog4_pd[_144PDENTRY] = val;
-
-	asm volatile("mov %0, %%cr3":: "b"(prog4_pd));	//moves page_directory address into the cr3 register
+	frame_free_contig((uint32_t)space, PROG_FRAMES);
+	prog_space[pid] = NULL;
+	prog_image[pid].valid = 0;
 }
 
-void prog5_init()
+/* 
+ * map_program
+ * Records a program image so its pages can be faulted in on first touch
+ * INPUTS: pid - process whose page directory is loaded in cr3
+ *		   image - parsed executable, copied
+ * OUTPUTS: 0 on success, -1 if the image can't be demand paged (caller copies it)
+ * EFFECTS: Nothing is read from the filesystem here, page_in fills each
+ *			page the first time the program (or the kernel on its behalf)
+ *			touches it, so startup cost scales with the pages used.
+ *			Without an image page_in only hands out zeroed frames.
+ */
+int32_t map_program(uint32_t pid, const elf_image_t* image)
 {
- 	uint32_t val = (uint32_t)prog5_pt;
-	val = val &	ADDR_MASK;
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog5_pd[0] = val;
-
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog5_pd[1]= val;
-
-	val = 0;
-	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
+	if (pid >= MAX_PROCESSES || prog_space[pid] == NULL || image == NULL || !image->valid)
 	{
-		prog5_pt[i] = val|PRWS_BIT; 	// sets present and super
-		val+=PAGE_SIZE;
+		return -1;
 	}
 
-	val = _8MB + _4MB * 4; 
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	prog5_pd[_128PDENTRY] = val; 
-	prog5_pt[0] = 0;					// initial page value should be null
+	prog_image[pid] = *image;							// elf_load already checked the segments fit
 
-	val = VIDMEM;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog5_vt[0] = val;
+	return 0;
+}
 
-	val = (uint32_t)prog5_vt;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog5_pd[_136PDENTRY] = val;
+/* 
+ * page_in
+ * Resolves a page fault inside the program page
+ * INPUTS: vaddr - faulting address
+ *		   error - page fault error code
+ *		   pid - process whose page directory is loaded in cr3
+ * OUTPUTS: 0 if the fault was resolved, -1 if it is a real error
+ * EFFECTS: A page that was never touched is filled in. If it lies wholly
+ *			inside one segment's file data and is only being read, it maps
+ *			the page-aligned filesystem block read-only. Otherwise it gets
+ *			a fresh frame, the parts of any PT_LOAD segments it covers,
+ *			and zeroes (bss, stack).
+ *			A write to a mapped block copies that block into a fresh frame.
+ *			Fails when the frame allocator is out of memory.
+ */
+int32_t page_in(uint32_t vaddr, uint32_t error, uint32_t pid)
+{
+	uint32_t* pd;
+	uint32_t* ut;
+	uint32_t index;
+	uint32_t page;
+	uint32_t offset;
+	uint32_t block;
+	uint32_t src;
+	uint32_t val;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t i;
+	const elf_image_t* image;
+	const elf_segment_t* seg;
 
-	val = _16MB + _16MB;
-	for (i = 0; i < TABLE_SIZE; i++)
+	if (vaddr < _128MB || vaddr >= _128MB + _4MB || pid >= MAX_PROCESSES)
 	{
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog5_term[i] = val;
-		val += PAGE_SIZE;
+		return -1;
 	}
 
-	val = (uint32_t)prog5_term;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	prog5_pd[_144PDENTRY] = val;
+	if (prog_space[pid] == NULL)
+	{
+		return -1;
+	}
 
-	asm volatile("mov %0, %%cr3":: "b"(prog5_pd));	//moves page_directory address into the cr3 register
-}
+	asm volatile("mov %%cr3, %0": "=b"(pd));
+	ut = prog_space[pid]->ut;
+	image = prog_image[pid].valid ? &prog_image[pid] : NULL;
+	if ((pd[_128PDENTRY] & ADDR_MASK) != (uint32_t)ut)
+	{
+		return -1;
+	}
 
-void prog6_init()
-{
- 	uint32_t val = (uint32_t)prog6_pt;
-	val = val &	ADDR_MASK;
+	index = (vaddr - _128MB) / PAGE_SIZE;
+	page = vaddr & ADDR_MASK;
 
-	val = val | PRESENT_BIT;			// present
-	val = val | RW_BIT; 				// rw 
-	prog6_pd[0] = val;
+	if (ut[index] & PRESENT_BIT)						// only copy-on-write faults are expected here
+	{
+		if (!(error & PF_WRITE) || !(ut[index] & FSMAP_BIT))
+		{
+			return -1;
+		}
+
+		src = ut[index] & ADDR_MASK;
+		val = frame_alloc();
+		if (val == 0)
+		{
+			return -1;
+		}
+		val = val | PRESENT_BIT;
+		val = val | RW_BIT;
+		val = val | USER_BIT;
+		ut[index] = val;
+		invlpg(page);
 
-	val = KERNEL_BEGIN;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | GLOBAL_BIT; 			// global
-	prog6_pd[1]= val;
+		memcpy((void*)page, (void*)src, PAGE_SIZE);
+		return 0;
+	}
 
-	val = 0;
-	uint32_t i;
-	for (i = 0; i < TABLE_SIZE; i++)	// setup first table from 0-4MB
+	for (i = 0; image != NULL && i < image->num_segments && !(error & PF_WRITE); i++)
 	{
-		prog6_pt[i] = val|PRWS_BIT; 	// sets present and super
-		val+=PAGE_SIZE;
+		seg = &image->segment[i];
+		if (page < seg->vaddr || page + PAGE_SIZE > seg->vaddr + seg->filesz)
+		{
+			continue;
+		}
+
+		offset = seg->offset + (page - seg->vaddr);
+		block = data_block_addr(image->inode, offset / PAGE_SIZE);
+		if ((offset & ~ADDR_MASK) == 0 && block != 0 && (block & ~ADDR_MASK) == 0)
+		{												// read-only, straight out of the filesystem
+			val = block;
+			val = val | PRESENT_BIT;
+			val = val | USER_BIT;
+			val = val | FSMAP_BIT;
+			ut[index] = val;
+			invlpg(page);
+			return 0;
+		}
 	}
 
-	val = _8MB + _4MB * 5;
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-
-	val = val | PRESENT_BIT; 			// present
-	val = val | RW_BIT; 				// rw
-	val = val | SIZE_BIT; 				// size
-	val = val | USER_BIT; 				// user
-	prog6_pd[_128PDENTRY] = val; 
-	prog6_pt[0] = 0;					// initial page value should be null
-
-	val = VIDMEM;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	val = val | USER_BIT;
-	prog6_vt[0] = val;
-
-	val = (uint32_t)prog6_vt;
-	val = val & ADDR_MASK;
+	val = frame_alloc();
+	if (val == 0)
+	{
+		return -1;
+	}
 	val = val | PRESENT_BIT;
 	val = val | RW_BIT;
 	val = val | USER_BIT;
-	prog6_pd[_136PDENTRY] = val;
+	ut[index] = val;
+	invlpg(page);
 
-	val = _16MB + _16MB;
-	for (i = 0; i < TABLE_SIZE; i++)
+	memset((void*)page, 0, PAGE_SIZE);
+	for (i = 0; image != NULL && i < image->num_segments; i++)			// copy in whatever file data overlaps the page
 	{
-		val = val & ADDR_MASK;
-		val = val | PRESENT_BIT;
-		val = val | RW_BIT;
-		prog6_term[i] = val;
-		val += PAGE_SIZE;
+		seg = &image->segment[i];
+		lo = (page > seg->vaddr) ? page : seg->vaddr;
+		hi = (page + PAGE_SIZE < seg->vaddr + seg->filesz) ? page + PAGE_SIZE : seg->vaddr + seg->filesz;
+		if (lo < hi)
+		{
+			read_data(image->inode, seg->offset + (lo - seg->vaddr), (uint8_t*)lo, hi - lo);
+		}
 	}
 
-	val = (uint32_t)prog6_term;
-	val = val & ADDR_MASK;
-	val = val | PRESENT_BIT;
-	val = val | RW_BIT;
-	prog6_pd[_144PDENTRY] = val;
-
-	asm volatile("mov %0, %%cr3":: "b"(prog6_pd));	//moves page_directory address into the cr3 register
+	return 0;
 }
@@ -4,6 +4,9 @@
 #include "lib.h"
 #include "types.h"
 #include "keyboard.h"
+#include "elf.h"
+#include "frame.h"
+#include "clock.h"
 
 /* Paging Constants */
 #define KERNEL_BEGIN    0x00400000	// 4MB bound
@@ -26,7 +29,12 @@
 #define CACHE_BIT		0x00000010
 #define IGNORE_BIT		0x00000080
 #define cr4_BITSET      0x00000010 	// bit set 4 of cr4  	   
+#define cr4_PGE			0x00000080 	// global pages survive cr3 reloads
+#define CPUID_FEATURES	1			// cpuid leaf with the feature flags
+#define CPUID_PGE		0x00002000 	// edx bit 13, page global enable supported
 #define cr0_ENABLE 		0x80000001 	// enable paging  
+#define cr0_WP			0x00010000 	// supervisor writes respect read-only pages
+#define FSMAP_BIT		0x00000200 	// available bit, marks a read-only filesystem block
 #define _128PDENTRY		32
 #define _136PDENTRY		34
 #define _144PDENTRY 	36
@@ -36,56 +44,72 @@
 #define VIRTUAL2		36
 #define VIRTUAL3		37
 #define MB136			0x08800000 
+#define TIME_PAGE		(MB136 + _4KB)	// read-only time page, next to vidmap
+#define TIME_PAGE_INDEX	1				// its entry in the video table
 #define VIDMEM			0x000B8000	// start of video memory
 
+/* Page Fault Error Code */
+#define PF_PRESENT		0x00000001	// fault on a present page
+#define PF_WRITE		0x00000002	// fault was a write
+#define PF_USER			0x00000004	// fault came from user mode
+
+/* Frames behind one program's prog_space_t */
+#define PROG_FRAMES		(sizeof(prog_space_t) / PAGE_SIZE)
+
+/* TLB Benchmark */
+#define TLB_BENCH_PAGES	128			// kernel 4KB pages touched after each cr3 reload
+#define TLB_BENCH_ITERS	1000
+
+/* Flushes the TLB entry for a single virtual address */
+#define invlpg(addr)                    \
+do {                                    \
+	asm volatile("invlpg (%0)"          \
+			:                           \
+			: "r" (addr)                \
+			: "memory" );               \
+} while(0)
+
+/* Size of the pid table, may be overridden at build time with -DMAX_PROCESSES=n.
+	How many programs actually run is bounded by free frames. */
+#ifndef MAX_PROCESSES
+#define MAX_PROCESSES	64
+#endif
+
 /* Initial Page Directory */
 uint32_t page_directory[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-/* Initial Page Table */
+/* Initial Page Table, shared by every program for kernel low memory */
 uint32_t page_table[TABLE_SIZE] __attribute__((aligned(_4KB)));
-/* Video Memory Table */
+/* Video Memory Table, used before any program runs */
 uint32_t vid_table[TABLE_SIZE] __attribute__((aligned(_4KB)));
+/* Terminal Buffer Table, shared by every program */
+uint32_t term_table[TABLE_SIZE] __attribute__((aligned(_4KB)));
 
-/* Page Directories for Programs 1-6 */
-uint32_t prog1_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog2_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog3_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog4_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog5_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog6_pd[DIRECTORY_SIZE] __attribute__((aligned(_4KB)));
-
-/* Page Tables for Programs 1-6 */
-uint32_t prog1_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog2_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog3_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog4_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog5_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog6_pt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-
-/* Video Tables for Programs 1-6 */
-uint32_t prog1_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog2_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog3_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog4_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog5_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog6_vt[TABLE_SIZE] __attribute__((aligned(_4KB)));
-
-/* Terminal Buffer Pages for Programs 1-6 */
-uint32_t prog1_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog2_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog3_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog4_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog5_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
-uint32_t prog6_term[TABLE_SIZE] __attribute__((aligned(_4KB)));
+/* Per-program paging structures, each table is one 4KB frame */
+typedef struct prog_space {
+	uint32_t pd[DIRECTORY_SIZE];	// page directory
+	uint32_t vt[TABLE_SIZE];		// video table for vidmap
+	uint32_t ut[TABLE_SIZE];		// 4KB image table when demand paged
+} prog_space_t;
 
 /* Paging Initialization */
 void paging_init();
 
-/* Initialization for Programs 1-6 */
-void prog1_init();
-void prog2_init();
-void prog3_init();
-void prog4_init();
-void prog5_init();
-void prog6_init();
+/* Changes a live mapping and flushes just its page, global ones included */
+void kernel_remap(uint32_t* table, uint32_t index, uint32_t val, uint32_t vaddr);
+
+/* Measures cr3 reload + kernel TLB refill cost with and without global pages */
+void tlb_bench(void);
+
+/* Address space for a program, built from frames and torn down on halt */
+int32_t prog_init(uint32_t pid);
+void prog_load(uint32_t pid);
+void prog_free(uint32_t pid);
+
+/* Points a program's vidmap page at the screen or its terminal's buffer */
+void prog_vidmap(uint32_t pid, int32_t terminal);
+
+/* Demand-paged program loading */
+int32_t map_program(uint32_t pid, const elf_image_t* image);
+int32_t page_in(uint32_t vaddr, uint32_t error, uint32_t pid);
 
 #endif
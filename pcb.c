@@ -4,67 +4,70 @@
  */ 
 #include "pcb.h"
 
-/*	pcb_init
- * 	INPUTS: none
- *  OUTPUTS: returns a newly initiliazed pcb	
- *  NOTES: Initializes PCB values, set FOPS table for stdin/stdout
- *			Returns PCB to be copied into kernel.	
+/*	pcb_alloc
+ * 	INPUTS: pid : process id for the new pcb
+ *			prev_pcb: last pcb on stack, NULL for the first on a terminal
+ *  OUTPUTS: returns the new pcb, NULL if memory ran out
+ *  NOTES: Takes the pcb and its fd table from their slab caches and
+ *			the kernel stack from the frame allocator. Initializes
+ *			PCB values in place, set FOPS table for stdin/stdout.
+ *			The pcb is its own parent when prev_pcb is NULL.
  */ 
-pcb_t pcb_init(){
-	pcb_t new_pcb;                      // create new pcb
+pcb_t* pcb_alloc(uint32_t pid, pcb_t* prev_pcb){
+	pcb_t* new_pcb;
 	int i;
-	for(i = 0; i < FOPS_NUM; i++){		// clear fd_entry
-		new_pcb.file_desc[i].fops_ptr = (func_t*) 0; 
-		new_pcb.file_desc[i].inode_ptr = 0;
-		new_pcb.file_desc[i].file_pos = 0; 
-		new_pcb.file_desc[i].flags = 0; 
+
+	new_pcb = cache_alloc(&pcb_cache);
+	if(new_pcb == NULL){
+		return NULL;
 	}
-	new_pcb.file_desc[STDIN_NUM].fops_ptr = stdin_jmp_table; 
-	new_pcb.file_desc[STDIN_NUM].inode_ptr = NULL;
-	new_pcb.file_desc[STDIN_NUM].file_pos = 0;
-	new_pcb.file_desc[STDIN_NUM].flags = 1;
+	memset(new_pcb, 0, sizeof(pcb_t));	// clear args and saved state
 
-	new_pcb.file_desc[STDOUT_NUM].fops_ptr = stdout_jmp_table; 
-	new_pcb.file_desc[STDOUT_NUM].inode_ptr = NULL;
-	new_pcb.file_desc[STDOUT_NUM].file_pos = 0;
-	new_pcb.file_desc[STDOUT_NUM].flags = 1;
+	new_pcb->file_desc = cache_alloc(&fd_cache);
+	new_pcb->kstack = frame_alloc_contig(KSTACK_FRAMES);
+	if(new_pcb->file_desc == NULL || new_pcb->kstack == 0){
+		pcb_free(new_pcb);
+		return NULL;
+	}
 
-	for(i = 0; i < ARG_SIZE; i++){  // clear args 
-		new_pcb.args[i] = 0; 
+	for(i = 0; i < FOPS_NUM; i++){		// clear fd_entry
+		new_pcb->file_desc[i].fops_ptr = (func_t*) 0; 
+		new_pcb->file_desc[i].inode_ptr = 0;
+		new_pcb->file_desc[i].file_pos = 0; 
+		new_pcb->file_desc[i].flags = 0; 
+		new_pcb->file_desc[i].rtc_freq = 0;
+		new_pcb->file_desc[i].rtc_tick = 0;
 	}
-	new_pcb.pid = 0;
-	new_pcb.esp = 0;
-	new_pcb.ebp = 0;
-	new_pcb.pagedir=0;
-	new_pcb.curr_esp = 0;
-	new_pcb.curr_ebp = 0;
-	new_pcb.curr_eip = 0;
-	new_pcb.curr_pd = 0;
-	new_pcb.status = 0;
+	new_pcb->file_desc[STDIN_NUM].fops_ptr = stdin_jmp_table; 
+	new_pcb->file_desc[STDIN_NUM].flags = 1;
+
+	new_pcb->file_desc[STDOUT_NUM].fops_ptr = stdout_jmp_table; 
+	new_pcb->file_desc[STDOUT_NUM].flags = 1;
+
+	new_pcb->pid = pid;
+	new_pcb->lastpcb_ptr = (prev_pcb == NULL) ? new_pcb : prev_pcb;
 
 	return new_pcb;
 }
 
-/*	setup_pcb
- * 	INPUTS: new_pcb : pcb pointer to source 
- *			pcb_loc : pcb pointer to dest
- *			prev_pcb: last pcb on stack
- *  OUTPUTS: returns 0 on success
- *  NOTES: Copies over new_pcb to pcb_loc (which is 
- *			current pcb) and sets the lastpcb pointer
- *			to prev_pcb
+/*	pcb_free
+ * 	INPUTS: pcb : pcb from pcb_alloc, may be partly built
+ *  OUTPUTS: none
+ *  NOTES: Returns the kernel stack, fd table and pcb. The caller
+ *			must not be running on that kernel stack. A pending alarm
+ *			is cancelled.
  */ 
-int32_t setup_pcb(pcb_t * new_pcb, pcb_t* pcb_loc, pcb_t* prev_pcb){
-
-	//copy new pcb from current space into kernel space.
-	memcpy((void*) pcb_loc, new_pcb, PCB_SIZE);  
-
-	// set pointer to last pcb
-	pcb_loc->lastpcb_ptr = prev_pcb; 
-
-	return 0;
+void pcb_free(pcb_t* pcb){
+	if(pcb == NULL){
+		return;
+	}
+	timer_cancel(&pcb->alarm);
+	if(pcb->stats != NULL){
+		kfree(pcb->stats);
+	}
+	if(pcb->kstack != 0){
+		frame_free_contig(pcb->kstack, KSTACK_FRAMES);
+	}
+	cache_free(&fd_cache, pcb->file_desc);
+	cache_free(&pcb_cache, pcb);
 }
-	
-
-
-	
@@ -5,6 +5,8 @@
 #include "filesys.h"
 #include "lib.h"
 #include "syscall.h"
+#include "slab.h"
+#include "timer.h"
 
 #define FOPS_NUM 8					// Number of max files 
 #define ARG_SIZE 128				// Length of argument
@@ -13,10 +15,9 @@
 #define PCB2_LOC 0x7FA000			// location of shell 2 PCB
 #define PCB3_LOC 0x7F8000			// location of shell 3 PCB
 #define EIGHT_KB 0x2000 
-#define FD_SIZE 16 					// size of an fd_entry	
-
-// 40 is from 10 uint32_t PCB values, 2 is from uint8_t
-#define PCB_SIZE FOPS_NUM*FD_SIZE + ARG_SIZE + 40 + 2
+#define KSTACK_FRAMES 2				// 8KB kernel stack per process
+#define PCB_STACK_TOP(pcb) ((pcb)->kstack + EIGHT_KB)	// initial esp0 for the process
+#define FD_SIZE 24 					// size of an fd_entry	
 #define CALL_OPEN 0
 #define CALL_READ 1
 #define CALL_WRITE 2
@@ -31,12 +32,14 @@ typedef struct fd_entry{
 	uint32_t inode_ptr;
 	uint32_t file_pos;
 	uint32_t flags;	
+	uint32_t rtc_freq;				// rtc only: virtual frequency, 0 until written (FREQ_MIN)
+	uint32_t rtc_tick;				// rtc only: hardware tick of the fd's next virtual tick
 } fd_entry_t;
 
 /*
 	PCB needs pid to jump back to current stack location after 
 	completion of program
-	Both parent and current esp,ebp,page_directorys are needed
+	The parent's esp,ebp,page_directory are needed
 	to correctly return after halt
 */
 typedef struct pcb {
@@ -45,26 +48,28 @@ typedef struct pcb {
 	uint32_t esp;					// esp,ebp, pagedir for shell
 	uint32_t ebp;
 	uint32_t pagedir;				
-	uint32_t curr_esp;				// esp,ebp,eip,page directory for user program
-	uint32_t curr_ebp;
-	uint32_t curr_eip;
-	uint32_t curr_pd;
 	uint32_t term_num;				// Terminal number on which program displays
-	int8_t status;					// Status code for return values
+	int32_t status;					// Status code for return values
 	struct pcb * lastpcb_ptr; 		// Pointer to parent pcb
+	uint32_t kstack;				// base of the kernel stack frames
 	uint8_t args[ARG_SIZE];			// space for process' arguments
-	fd_entry_t file_desc[FOPS_NUM]; // process' file descriptor array
+	fd_entry_t* file_desc;			// process' file descriptor array, FOPS_NUM entries from fd_cache
+	timer_t alarm;					// armed by the alarm syscall
+	timer_t* sleep_timer;			// timer of the sleep in progress, NULL otherwise
+	uint32_t alarm_pending;			// alarm fired, cleared by the next sleep
+	struct syscall_stat* stats;		// SYSCALL_COUNT counters, kmalloc'd on the first call recorded
+	uint32_t vga_pinned;			// called vidmap, holds a vga_pin on its terminal
 
 } pcb_t;
 
 /* Array of PCB for three terminals */
 extern pcb_t* pcb_loc[NUM_TERM];
 
-/* Creates a new pcb */
-pcb_t pcb_init();
+/* Creates a new pcb with its fd table and kernel stack */
+pcb_t* pcb_alloc(uint32_t pid, pcb_t* prev_pcb);
 
-/* maps the new pcb over to the proper memory location */
-int32_t setup_pcb(pcb_t* new_pcb, pcb_t* pcb_loc, pcb_t* prev_pcb);
+/* Releases a pcb and everything pcb_alloc gave it */
+void pcb_free(pcb_t* pcb);
 
 #endif 
 
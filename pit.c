@@ -1,4 +1,5 @@
 #include "pit.h" 
+#include "sched.h"
 
 /*
  *	void set_pit_rate(int hz);
@@ -28,14 +29,58 @@ void pit_init()
 	outb(MAXDIV >> UPPERSHIFT, CHANNEL0);		// writes the upper byte to channel 0
 }
 
+/*
+ *	uint32_t pit_calibrate_tsc();
+ *  	Inputs: none
+ *   	Return Value: TSC frequency in kHz, 0 if it could not be measured
+ *		Function: Counts TSC cycles while channel 2 counts down
+ *				  CALIBRATE_MS milliseconds. Channel 2 is polled through
+ *				  port 0x61, so channel 0 and interrupts are untouched.
+ *				  The speaker stays off.
+ */
+uint32_t pit_calibrate_tsc(void)
+{
+	uint8_t gate = inb(PIT_GATE);
+	uint64_t start, end;
+	uint32_t loops = 0;
+
+	outb((gate & ~SPEAKER) | GATE2, PIT_GATE);		// enable channel 2, speaker off
+	outb(MODE0_CH2, COMMANDREG);
+	outb(CALIBRATE_LATCH & LOWERMASK, CHANNEL2);		// counting starts after the upper byte
+	outb(CALIBRATE_LATCH >> UPPERSHIFT, CHANNEL2);
+
+	start = rdtsc();
+	while ((inb(PIT_GATE) & OUT2) == 0 && loops < CALIBRATE_LOOPS)
+	{
+		loops++;
+	}
+	end = rdtsc();
+
+	outb(gate, PIT_GATE);
+	if (loops == CALIBRATE_LOOPS)
+	{
+		return 0;
+	}
+	return div64_32(end - start, CALIBRATE_MS, NULL);
+}
+
 /*
  *	void pit_handler();
  *  	Inputs: none
  *   	Return Value: none
- *		Function: Handles PIT interrupts.
+ *		Function: Handles PIT interrupts. Each tick advances the timer
+ *				  wheel, every SCHED_TICKS ticks end the running task's
+ *				  quantum. Runs with interrupts off through an interrupt
+ *				  gate. The EOI goes out first because the scheduler
+ *				  returns only when this task runs again.
  */
 void pit_handler()
 {
-	//scheduler();
 	send_eoi(PIT);
+	timer_tick();
+	clock_tick();
+	if (timer_ticks % SCHED_TICKS == 0)
+	{
+		scheduler();
+	}
 }
@@ -10,8 +10,16 @@
 
 #define PIT 		0x00
 #define CHANNEL0	0x40
+#define CHANNEL2	0x42
 #define COMMANDREG	0x43
 
+/* Channel 2 gate, the speaker and channel 2's output share port 0x61 */
+#define PIT_GATE	0x61
+#define GATE2		0x01
+#define SPEAKER		0x02
+#define OUT2		0x20
+#define MODE0_CH2	0xB0		// channel 2, lobyte/hibyte, interrupt on terminal count
+
 #define MODE2		0x34
 #define MODE3		0x36
 
@@ -19,9 +27,15 @@
 #define LOWERMASK	0xFF
 #define UPPERSHIFT	8
 
+/* TSC calibration window */
+#define CALIBRATE_MS	50
+#define CALIBRATE_LATCH	(OSCILLATOR / (1000 / CALIBRATE_MS))
+#define CALIBRATE_LOOPS	0x1000000	// give up if OUT2 never rises
+
 /* PIT Functions */
 void set_pit_rate(int hz);
 void pit_init();
 void pit_handler();
+uint32_t pit_calibrate_tsc(void);
 
 #endif
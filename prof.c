@@ -0,0 +1,172 @@
+/**
+***	prof.c: Statistical sampling profiler driven by the PIT.
+**/
+
+#include "prof.h"
+#include "lib.h"
+#include "pcb.h"
+#include "keyboard.h"
+#include "frame.h"
+
+static prof_sample_t prof_ring[PROF_SAMPLES];
+static uint32_t prof_next = 0;		// slot the next sample goes in
+static uint32_t prof_count = 0;		// samples held, at most PROF_SAMPLES
+static uint32_t prof_on = 0;
+
+/* 
+ * prof_sample
+ * Records where the PIT interrupted
+ * INPUTS: frame - registers pit1 saved
+ * OUTPUTS: none
+ * EFFECTS: Stores the eip and privilege level. For kernel code it also
+ *			follows the saved ebp chain for up to PROF_DEPTH return
+ *			addresses, stopping as soon as a frame pointer leaves the
+ *			interrupted stack or stops growing toward its base, so code
+ *			built without frame pointers only costs depth, not a fault.
+ *			User stacks are not walked, they may not be paged in, and
+ *			nothing past the kernel direct map is read.
+ */
+void prof_sample(irq_frame_t* frame)
+{
+	prof_sample_t* sample;
+	uint32_t ebp, low, high;
+
+	if (!prof_on)
+	{
+		return;
+	}
+
+	sample = &prof_ring[prof_next];
+	sample->eip = frame->eip;
+	sample->cpl = frame->cs & CPL_MASK;
+	sample->depth = 0;
+
+	if (sample->cpl == 0)
+	{
+		low = (uint32_t)(frame + 1);			// interrupted esp, no stack switch
+		high = low + PROF_STACK;
+		if (high > FRAME_LIMIT)					// the direct map ends there
+		{
+			high = FRAME_LIMIT;
+		}
+		ebp = frame->ebp;
+		while (sample->depth < PROF_DEPTH && ebp >= low && ebp + 2 * sizeof(uint32_t) <= high && (ebp & 0x3) == 0)
+		{
+			sample->stack[sample->depth++] = ((uint32_t*)ebp)[1];
+			low = ebp + sizeof(uint32_t);
+			ebp = ((uint32_t*)ebp)[0];
+		}
+	}
+
+	prof_next = (prof_next + 1) % PROF_SAMPLES;
+	if (prof_count < PROF_SAMPLES)
+	{
+		prof_count++;
+	}
+}
+
+/* 
+ * hex
+ * Writes a number as 8 hex digits
+ * INPUTS: out - where the digits go
+ *		   n - number
+ * OUTPUTS: none
+ * EFFECTS: fixed width so the host script can split on spaces
+ */
+static void hex(int8_t* out, uint32_t n)
+{
+	int32_t i;
+
+	for (i = 7; i >= 0; i--)
+	{
+		out[i] = "0123456789abcdef"[n & 0xF];
+		n >>= 4;
+	}
+}
+
+/* 
+ * prof_read
+ * Dumps the samples as text
+ * INPUTS: fd - open sys/prof
+ *		   buf - where the text goes
+ *		   nbytes - its size, at least PROF_LINE_MAX
+ * OUTPUTS: bytes read, 0 once every sample has been read, -1 on a small
+ *			or missing buffer
+ * EFFECTS: One line per sample, oldest first: cpl, eip, then the return
+ *			addresses, all in hex. Only whole lines are returned, and
+ *			file_pos counts samples rather than bytes.
+ */
+int32_t prof_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	fd_entry_t* entry = &pcb_loc[sched_terminal]->file_desc[fd];
+	prof_sample_t* sample;
+	int8_t* out = buf;
+	int32_t len = 0;
+	uint32_t i;
+
+	if (buf == NULL || nbytes < PROF_LINE_MAX)
+	{
+		return -1;
+	}
+
+	while (entry->file_pos < prof_count && len + PROF_LINE_MAX <= nbytes)
+	{
+		sample = &prof_ring[(prof_next + PROF_SAMPLES - prof_count + entry->file_pos) % PROF_SAMPLES];
+		out[len++] = '0' + sample->cpl;
+		out[len++] = ' ';
+		hex(&out[len], sample->eip);
+		len += 8;
+		for (i = 0; i < sample->depth; i++)
+		{
+			out[len++] = ' ';
+			hex(&out[len], sample->stack[i]);
+			len += 8;
+		}
+		out[len++] = '\n';
+		entry->file_pos++;
+	}
+	return len;
+}
+
+/* 
+ * prof_write
+ * Controls the profiler
+ * INPUTS: fd - open sys/prof
+ *		   buf - "start", "stop" or "reset", a trailing newline is fine
+ *		   nbytes - its length
+ * OUTPUTS: nbytes on success, -1 on an unknown command
+ * EFFECTS: start also clears the old samples, stop keeps them for reading.
+ */
+int32_t prof_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	const int8_t* cmd = buf;
+	uint32_t flags;
+
+	if (buf == NULL)
+	{
+		return -1;
+	}
+
+	cli_and_save(flags);
+	if (nbytes >= 5 && strncmp(cmd, "start", 5) == 0)
+	{
+		prof_next = 0;
+		prof_count = 0;
+		prof_on = 1;
+	}
+	else if (nbytes >= 4 && strncmp(cmd, "stop", 4) == 0)
+	{
+		prof_on = 0;
+	}
+	else if (nbytes >= 5 && strncmp(cmd, "reset", 5) == 0)
+	{
+		prof_next = 0;
+		prof_count = 0;
+	}
+	else
+	{
+		nbytes = -1;
+	}
+	restore_flags(flags);
+	return nbytes;
+}
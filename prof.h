@@ -0,0 +1,37 @@
+#ifndef _PROF_H
+#define _PROF_H
+
+#include "types.h"
+
+/* Sampling profiler, one sample per PIT tick while running */
+#define PROF_SAMPLES	2048		// ring size, the oldest samples are overwritten
+#define PROF_DEPTH		6			// return addresses kept per sample
+#define PROF_STACK		0x2000		// a kernel backtrace stays within this much stack
+#define PROF_LINE_MAX	80			// longest line prof_read produces
+#define CPL_MASK		0x3
+
+/* What pit1 leaves on the stack: pushal's registers, then the cpu's
+ * interrupt frame. Interrupts from ring 3 also push esp and ss. */
+typedef struct irq_frame {
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+	uint32_t eip;
+	uint32_t cs;
+	uint32_t eflags;
+} irq_frame_t;
+
+typedef struct prof_sample {
+	uint32_t eip;					// interrupted instruction
+	uint8_t cpl;					// 0 kernel, 3 user
+	uint8_t depth;					// valid entries in stack
+	uint16_t reserved;
+	uint32_t stack[PROF_DEPTH];		// return addresses, innermost first
+} prof_sample_t;
+
+/* Called by the PIT with the interrupted context */
+void prof_sample(irq_frame_t* frame);
+
+/* sys/prof: reading dumps the samples, writing start, stop or reset controls sampling */
+int32_t prof_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t prof_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Symbolizes a sys/prof dump against the kernel image.
+
+Usage: prof_symbolize.py bootimg dump.txt [folded.txt]
+
+Prints a flat profile, samples per function, to stdout. When a third
+argument is given, also writes folded stacks (outermost frame first,
+one "a;b;c count" line per distinct stack) for flamegraph.pl.
+"""
+
+import bisect
+import subprocess
+import sys
+from collections import Counter
+
+
+def load_symbols(image):
+    """Returns sorted (address, name) pairs for the image's functions."""
+    out = subprocess.run(["nm", "-n", image], check=True,
+                         capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            syms.append((int(parts[0], 16), parts[2]))
+    return syms
+
+
+def symbolize(syms, addrs, addr):
+    """Name of the function containing addr."""
+    i = bisect.bisect_right(addrs, addr) - 1
+    return syms[i][1] if i >= 0 else "0x%08x" % addr
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    syms = load_symbols(sys.argv[1])
+    addrs = [a for a, _ in syms]
+
+    flat = Counter()
+    folded = Counter()
+    total = 0
+    with open(sys.argv[2]) as dump:
+        for line in dump:
+            fields = line.split()
+            if len(fields) < 2 or fields[0] not in ("0", "3"):
+                continue
+            total += 1
+            if fields[0] == "3":
+                flat["[user]"] += 1
+                folded["[user]"] += 1
+                continue
+            # return addresses point after the call, step back into it
+            frames = [symbolize(syms, addrs, int(fields[1], 16))]
+            frames += [symbolize(syms, addrs, int(f, 16) - 1) for f in fields[2:]]
+            flat[frames[0]] += 1
+            folded[";".join(reversed(frames))] += 1
+
+    if total == 0:
+        sys.exit("no samples")
+    print("%8s %6s  %s" % ("samples", "%", "function"))
+    for name, count in flat.most_common():
+        print("%8d %6.2f  %s" % (count, 100.0 * count / total, name))
+
+    if len(sys.argv) > 3:
+        with open(sys.argv[3], "w") as out:
+            for stack, count in sorted(folded.items()):
+                out.write("%s %d\n" % (stack, count))
+
+
+if __name__ == "__main__":
+    main()
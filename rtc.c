@@ -1,9 +1,18 @@
 #include "rtc.h"
+#include "pcb.h"
+#include "sched.h"
+#include "klog.h"
 
 /**
 ***	Local Variable:
 **/
-static int32_t int_flag = LOW;
+volatile uint32_t rtc_ticks = 0;
+
+/* readers waiting for their fd's next virtual tick */
+static wait_queue_t rtc_queue = WAIT_QUEUE_INIT;
+
+/* earliest rtc_tick of the readers on rtc_queue */
+static uint32_t rtc_wake = 0;
 
 /**
 ***	RTC Initialization and Handling:
@@ -13,7 +22,8 @@ static int32_t int_flag = LOW;
  *	void rtc_init();
  *  	Inputs: void
  *  	Return Value: none
- *		Function: Initializes the RTC.
+ *		Function: Initializes the RTC. Interrupts run at RTC_HW_FREQ
+ *				  from here on, each fd divides them down to its own rate.
  */
 void rtc_init()
 {
@@ -21,6 +31,11 @@ void rtc_init()
 	int8_t prev = inb(RTC_DATA);						// read the current value of the register	
 	outb(NMI_DISABLE | STATUS_B, RTC_INDEX);			// select the register again
 	outb(prev | INT_ON, RTC_DATA);						// write to the register to turn on interrupts
+
+	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);			// select register A
+	prev = inb(RTC_DATA);								// reads the current value of the register
+	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);			// select register A again 
+	outb((prev & RATE_MASK) | RTC_HW_RATE, RTC_DATA);	// fixed hardware rate
 	outb(STATUS_B, RTC_INDEX);							// turn on NMI
 }
 
@@ -28,20 +43,118 @@ void rtc_init()
  *	void rtc_handler();
  *  	Inputs: void
  *   	Return Value: none
- *		Function: Handles RTC interrupts.
+ *		Function: Handles RTC interrupts. Counts the tick and wakes the
+ *				  readers once the earliest of their deadlines is reached.
+ *				  Runs with interrupts off (an interrupt gate) since it
+ *				  touches the run queues.
  */
 void rtc_handler()
 {
 	//test_interrupts();
-	sti();
-	enable_irq(RTC);
-	int_flag = HIGH;
+	rtc_ticks++;
+	if (rtc_queue.head != NULL && (int32_t)(rtc_ticks - rtc_wake) >= 0)
+	{
+		wake_all(&rtc_queue);							// readers not yet due sleep again
+	}
 	outb(STATUS_C, RTC_INDEX);							// pick register c
 	inb(RTC_DATA);										// throw away the contents
 	send_eoi(RTC);										// send an end of interrupt signal
 }
 
 
+/*
+ *	uint8_t cmos_read(uint8_t reg);
+ *  	Inputs: reg - CMOS register
+ *   	Return Value: the register's value
+ *		Function: Reads a CMOS register with NMI off.
+ */
+static uint8_t cmos_read(uint8_t reg)
+{
+	outb(NMI_DISABLE | reg, RTC_INDEX);
+	return inb(RTC_DATA);
+}
+
+/*
+ *	uint8_t bcd_to_bin(uint8_t val);
+ *  	Inputs: val - two BCD digits
+ *   	Return Value: val in binary
+ *		Function: Converts the CMOS's BCD fields.
+ */
+static uint8_t bcd_to_bin(uint8_t val)
+{
+	return (val & 0x0F) + (val >> 4) * 10;
+}
+
+/*
+ *	uint32_t rtc_get_time();
+ *  	Inputs: void
+ *   	Return Value: seconds since 1970-01-01 00:00 UTC
+ *		Function: Reads the wall clock from the CMOS. The fields are
+ *				  read until two passes agree so an update can't tear
+ *				  them, then turned into a day count with the civil
+ *				  calendar's 400 year cycle. The CMOS is assumed to
+ *				  hold UTC.
+ */
+uint32_t rtc_get_time(void)
+{
+	static const uint8_t regs[CMOS_FIELDS] = {CMOS_SECONDS, CMOS_MINUTES, CMOS_HOURS,
+											  CMOS_DAY, CMOS_MONTH, CMOS_YEAR};
+	uint8_t now[CMOS_FIELDS], last[CMOS_FIELDS];
+	uint8_t status;
+	int32_t i, same, pm;
+	int32_t sec, min, hour, day, month, year;
+	int32_t era, yoe, doy, doe;
+
+	do
+	{
+		while (cmos_read(STATUS_A) & UPDATE_IN_PROGRESS);	// wait out an update
+		for (i = 0; i < CMOS_FIELDS; i++)
+		{
+			last[i] = cmos_read(regs[i]);
+		}
+		while (cmos_read(STATUS_A) & UPDATE_IN_PROGRESS);
+		same = 1;
+		for (i = 0; i < CMOS_FIELDS; i++)
+		{
+			now[i] = cmos_read(regs[i]);
+			same &= (now[i] == last[i]);
+		}
+	} while (!same);
+
+	status = cmos_read(STATUS_B);
+	outb(STATUS_B, RTC_INDEX);							// turn on NMI
+
+	pm = now[2] & HOUR_PM;
+	now[2] &= ~HOUR_PM;
+	if (!(status & BINARY_MODE))
+	{
+		for (i = 0; i < CMOS_FIELDS; i++)
+		{
+			now[i] = bcd_to_bin(now[i]);
+		}
+	}
+	sec = now[0];
+	min = now[1];
+	hour = now[2];
+	day = now[3];
+	month = now[4];
+	year = CMOS_CENTURY + now[5];
+	if (!(status & HOUR_24))
+	{
+		hour = hour % 12 + (pm ? 12 : 0);				// 12am is hour 0
+	}
+
+	/* days since 1970, counting years from March so leap days come last */
+	year -= (month <= 2);
+	era = year / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return (uint32_t)(era * DAYS_PER_ERA + doe - EPOCH_DAYS) * SECS_PER_DAY
+		+ hour * 3600 + min * 60 + sec;
+}
+
 
 /**
 ***	Terminal System Calls:
@@ -52,76 +165,80 @@ void rtc_handler()
  *  	Inputs: filename - does nothing
  *   	Return Value: Returns 0.
  *		Function: Open function for the RTC.
- *				  Sets RTC to 2 Hz.
+ *				  The new fd starts out at 2 Hz. The hardware rate is
+ *				  left alone so other open fds keep their timing.
  */
 int32_t rtc_open(const uint8_t * filename)
 {
-	rtc_init();
-	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);			// select register A + turn off NMI
-	int8_t prev = inb(RTC_DATA);						// reads the current value of the register
-	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);			// select register A again 
-	outb((prev & RATE_MASK) | TWO_HZ, RTC_DATA);		// set rate to 2 hz
-	outb(STATUS_B, RTC_INDEX);
 	return 0;
 }
 
 /*
  *	int32_t rtc_read(int32_t fd, char * buf, int32_t nbytes);
- *  	Inputs: fd     - does nothing
+ *  	Inputs: fd     - rtc file descriptor
  *				buf    - does nothing
  * 				nbytes - does nothing
  *   	Return Value: Returns 0.
  *		Function: Read function for the RTC.
- *				  Waits for an RTC interrupt, and then returns.
+ *				  Sleeps until the fd's next virtual interrupt, i.e. the
+ *				  next multiple of its period in hardware ticks, the
+ *				  same wait a real RTC at the fd's rate would give.
  */
 int32_t rtc_read(int32_t fd, char * buf, int32_t nbytes)
 {
-	sti();
-	while(int_flag != HIGH);  // waits for interrupt handler to trigger before proceeding
-	int_flag = LOW;
+	fd_entry_t* entry = &pcb_loc[sched_terminal]->file_desc[fd];
+	uint32_t frequency = (entry->rtc_freq != 0) ? entry->rtc_freq : FREQ_MIN;
+	uint32_t period = RTC_HW_FREQ / frequency;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	entry->rtc_tick = (rtc_ticks / period + 1) * period;		// periods divide 2^32, so this survives wraparound
+
+	while ((int32_t)(rtc_ticks - entry->rtc_tick) < 0)		// sleep, other tasks run meanwhile
+	{
+		if (rtc_queue.head == NULL || (int32_t)(entry->rtc_tick - rtc_wake) < 0)
+		{
+			rtc_wake = entry->rtc_tick;
+		}
+		sleep_on(&rtc_queue);
+	}
+	restore_flags(flags);
 	return 0;
 }
 
 /*
  *	int32_t rtc_write(int32_t fd, const char * buf, int32_t nbytes);
- *  	Inputs: fd     - does nothing
- * 				buf    - buffer with the first element being the 
- *					     frequency to be set.
- * 				nbytes - does nothing
+ *  	Inputs: fd     - rtc file descriptor
+ * 				buf    - buffer holding the frequency to be set
+ *					     as an int32_t.
+ * 				nbytes - must be 4
  *   	Return Value: Returns 0 on success, -1 on failure.
  *		Function: Write function for the RTC.
- *				  Sets a new frequency for the RTC.
+ *				  Sets a new virtual frequency for this fd only.
  */
 int32_t rtc_write(int32_t fd, const char * buf, int32_t nbytes)
 {
-	int32_t frequency = (int32_t)buf[0];
-	int32_t temp = frequency;
-	int32_t rate = 1;
+	int32_t frequency;
 
-	if (frequency < FREQ_MIN || frequency > FREQ_MAX) 		// checks that the rate is within 2 and 1024 Hz
+	if (buf == NULL || nbytes != sizeof(int32_t))
 	{
-		printk("Invalid frequency. Outside range.\n");
 		return -1;
 	}
+	frequency = *(const int32_t*)buf;
 
-	if ((frequency & (frequency - 1))) 						// checks that the rate is a power of 2
+	if (frequency < FREQ_MIN || frequency > FREQ_MAX) 		// checks that the rate is within 2 and 1024 Hz
 	{
-		printk("Invalid frequency. Not a power of two.\n");
+		klog(KLOG_WARN, "rtc: invalid frequency %d, outside range", frequency);
 		return -1;
 	}
 
-	temp = THEORY_MAX / frequency;
-	while (temp != 1)										// calculates the rate the RTC uses
+	if ((frequency & (frequency - 1))) 						// checks that the rate is a power of 2
 	{
-		rate++;
-		temp /= 2;
+		klog(KLOG_WARN, "rtc: invalid frequency %d, not a power of two", frequency);
+		return -1;
 	}
 
-	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);				// select register A + turn off NMI
-	char prev = inb(RTC_DATA);								// reads the current value of the register
-	outb(NMI_DISABLE | STATUS_A, RTC_INDEX);				// select register A again 
-	outb((prev & RATE_MASK) | rate, RTC_DATA);				// set rate to whatever rate is
-	outb(STATUS_B, RTC_INDEX);
+	pcb_loc[sched_terminal]->file_desc[fd].rtc_freq = frequency;
 
 	return 0;
 }
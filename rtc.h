@@ -15,6 +15,8 @@
 #define INT_ON 0x40
 #define RATE_MASK 0xF0
 #define TWO_HZ 0x0F
+#define RTC_HW_RATE 0x06			// rate register value for RTC_HW_FREQ
+#define RTC_HW_FREQ 1024			// the hardware always runs at FREQ_MAX
 
 #define FREQ_MIN 2
 #define FREQ_MAX 1024
@@ -23,12 +25,37 @@
 #define LOW 0
 #define HIGH 1
 
+/* CMOS clock registers */
+#define CMOS_SECONDS 0x00
+#define CMOS_MINUTES 0x02
+#define CMOS_HOURS 0x04
+#define CMOS_DAY 0x07
+#define CMOS_MONTH 0x08
+#define CMOS_YEAR 0x09
+#define CMOS_FIELDS 6
+#define UPDATE_IN_PROGRESS 0x80		// status A: the clock is mid update
+#define BINARY_MODE 0x04			// status B: fields are binary, not BCD
+#define HOUR_24 0x02				// status B: 24 hour clock
+#define HOUR_PM 0x80				// hours field: pm in 12 hour mode
+#define CMOS_CENTURY 2000			// the year register only holds two digits
+
+/* Days from 0000-03-01 to 1970-01-01 in the proleptic Gregorian calendar */
+#define EPOCH_DAYS 719468
+#define DAYS_PER_ERA 146097
+#define SECS_PER_DAY 86400
+
+/* Hardware ticks since rtc_init */
+extern volatile uint32_t rtc_ticks;
+
 /* RTC Initialization */
 void rtc_init(void);
 
 /* RTC Handler */ 
 void rtc_handler(void);
 
+/* Wall clock time from the CMOS, in seconds since 1970 UTC */
+uint32_t rtc_get_time(void);
+
 /* Terminal System Calls */
 int32_t rtc_open(const uint8_t * filename);
 int32_t rtc_read(int32_t fd, char * buf, int32_t nbytes);
@@ -1,109 +1,383 @@
 #include "sched.h"
+#include "trace.h"
 
-/* queues for the scheduler */ 
-static process_t* run_queue = NULL;
-static process_t* expired_queue = NULL;
-static uint32_t sched_esp; 
+/* task for each terminal, NULL until the terminal is first shown */
+static process_t* task[NUMTERMINALS] = {NULL, NULL, NULL};
+
+/* queues for the scheduler, the running task is in neither */
+static sched_queue_t active_queue = {NULL, NULL};
+static sched_queue_t expired_queue = {NULL, NULL};
+static process_t* running = NULL;
+
+/* runs hlt whenever every task is asleep, never queued */
+static process_t* idle = NULL;
+
+/* rdtsc when the last switch started, 0 when no switch is in flight */
+static uint64_t switch_start = 0;
+static switch_stats_t switch_stats = {0, 0, 0xFFFFFFFF, 0, 0};
+
+/*
+ *	void enqueue(sched_queue_t* queue, process_t* process)
+ *  	Inputs: queue - queue to add to
+ *				process - task to add at the tail
+ *  	Return Value: none
+ *		Function: O(1) append through the tail pointer
+ */
+static void enqueue(sched_queue_t* queue, process_t* process){
+	process->next = NULL;
+	if(queue->tail == NULL)
+		queue->head = process;
+	else
+		queue->tail->next = process;
+	queue->tail = process;
+}
+
+/*
+ *	process_t* dequeue(sched_queue_t* queue)
+ *  	Inputs: queue - queue to take from
+ *  	Return Value: task at the head, NULL if the queue is empty
+ *		Function: O(1) removal from the head
+ */
+static process_t* dequeue(sched_queue_t* queue){
+	process_t* process = queue->head;
+	if(process != NULL){
+		queue->head = process->next;
+		if(queue->head == NULL)
+			queue->tail = NULL;
+		process->next = NULL;
+	}
+	return process;
+}
+
+/*
+ *	void sched_switch(process_t* prev, process_t* next)
+ *  	Inputs: prev - running task
+ *				next - task to run
+ *  	Return Value: none, returns when prev is scheduled again
+ *		Function: Points the kernel at next and calls switch_to. The
+ *				  time from the call in prev to the return in the task
+ *				  it resumes is one switch's latency.
+ */
+static void sched_switch(process_t* prev, process_t* next){
+	uint32_t cycles;
+
+	TRACE(TR_SCHED, next->terminal);
+	running = next;
+	if(next->terminal != IDLE_TERMINAL)
+		sched_terminal = next->terminal;
+
+	/* kernel stack of the program the task returns to */
+	if(next->terminal != IDLE_TERMINAL && prog_count[next->terminal] != 0)
+		next->esp0 = PCB_STACK_TOP(pcb_loc[next->terminal]);
+	else
+		next->esp0 = tss.esp0;
+
+	switch_start = rdtsc();
+	switch_to(prev, next);
+
+	/* prev is running again */
+	if(switch_start != 0){
+		cycles = (uint32_t)(rdtsc() - switch_start);
+		switch_start = 0;
+		switch_stats.count++;
+		switch_stats.last = cycles;
+		if(cycles < switch_stats.min)
+			switch_stats.min = cycles;
+		if(cycles > switch_stats.max)
+			switch_stats.max = cycles;
+		if(switch_stats.count == 1)
+			switch_stats.avg = cycles;
+		else
+			switch_stats.avg = switch_stats.avg - (switch_stats.avg >> SWITCH_AVG_SHIFT) + (cycles >> SWITCH_AVG_SHIFT);
+	}
+}
+
+/*
+ *	process_t* pick_next()
+ *  	Inputs: none
+ *  	Return Value: next runnable task, NULL if there is none
+ *		Function: Takes the head of the active queue. When every task
+ *				  has had its turn the queues swap first.
+ */
+static process_t* pick_next(void){
+	process_t* next;
+	sched_queue_t temp;
+
+	next = dequeue(&active_queue);
+	if(next == NULL){
+		/* rotation complete, swap queues */
+		temp = active_queue;
+		active_queue = expired_queue;
+		expired_queue = temp;
+		next = dequeue(&active_queue);
+	}
+	return next;
+}
+
+/*
+ *	process_t* task_create(int32_t terminal, void (*entry)(int32_t))
+ *  	Inputs: terminal - terminal the task runs programs for
+ *				entry - function the task starts in, must not return
+ *  	Return Value: the task, NULL if out of memory
+ *		Function: Gives a task its own kernel stack. The stack starts out
+ *				  looking like switch_to left it, with entry as the return
+ *				  address, so the first switch to the task calls entry.
+ */
+static process_t* task_create(int32_t terminal, void (*entry)(int32_t)){
+	process_t* new_process;
+	uint32_t* stack;
+
+	new_process = cache_alloc(&process_cache);
+	if(new_process == NULL)
+		return NULL;
+	new_process->kstack = frame_alloc_contig(KSTACK_FRAMES);
+	if(new_process->kstack == 0){
+		cache_free(&process_cache, new_process);
+		return NULL;
+	}
+	new_process->terminal = terminal;
+	new_process->esp0 = 0;
+	new_process->pd = (uint32_t)page_directory;
+	new_process->next = NULL;
+
+	stack = (uint32_t*)(new_process->kstack + KSTACK_FRAMES * FRAME_SIZE);
+	*(--stack) = terminal;						// entry's argument
+	*(--stack) = 0;								// entry never returns
+	*(--stack) = (uint32_t)entry;				// switch_to returns here
+	*(--stack) = INIT_EFLAGS;
+	*(--stack) = 0;								// ebp
+	*(--stack) = 0;								// ebx
+	*(--stack) = 0;								// esi
+	*(--stack) = 0;								// edi
+	new_process->esp = (uint32_t)stack;
+
+	return new_process;
+}
+
+/*
+ *	void idle_main(int32_t unused)
+ *  	Inputs: unused - task_create's argument
+ *  	Return Value: never returns
+ *		Function: Halts until an interrupt makes a task runnable, then
+ *				  gives it the cpu without waiting for the next tick.
+ *				  sti only takes effect after the next instruction, so
+ *				  a wakeup can't slip in between the check and the hlt.
+ */
+static void idle_main(int32_t unused){
+	switch_start = 0;			// a first run is not a resumed switch
+
+	while(1){
+		cli();
+		if(active_queue.head != NULL || expired_queue.head != NULL)
+			scheduler();
+		asm volatile("sti; hlt");
+	}
+}
+
+/*
+ *	void sched_init()
+ *  	Inputs: none
+ *  	Return Value: none
+ *		Function: Wraps the boot stack, which runs terminal 1's shell
+ *				  loop, in a task so it can be switched out, and creates
+ *				  the idle task. Must run before the PIT is unmasked.
+ */
+void sched_init(void){
+	process_t* boot = cache_alloc(&process_cache);
+	if(boot == NULL)
+		return;
+	idle = task_create(IDLE_TERMINAL, idle_main);
+	boot->terminal = TERM_1;
+	boot->esp = 0;
+	boot->esp0 = 0;
+	boot->pd = (uint32_t)page_directory;
+	boot->kstack = 0;
+	boot->next = NULL;
+	task[TERM_1] = boot;
+	running = boot;
+	sched_terminal = TERM_1;
+}
+
+/*
+ *	int32_t sched_add_terminal(int32_t terminal)
+ *  	Inputs: terminal - terminal that needs a shell
+ *  	Return Value: 0 if the terminal has a task, -1 if out of memory
+ *		Function: Gives the terminal a task that starts terminal_main
+ *				  and queues it.
+ */
+int32_t sched_add_terminal(int32_t terminal){
+	process_t* new_process;
+	uint32_t flags;
+
+	if(terminal < 0 || terminal >= NUMTERMINALS)
+		return -1;
+	if(task[terminal] != NULL)
+		return 0;
+
+	new_process = task_create(terminal, terminal_main);
+	if(new_process == NULL)
+		return -1;
+
+	cli_and_save(flags);
+	task[terminal] = new_process;
+	enqueue(&active_queue, new_process);
+	restore_flags(flags);
+	return 0;
+}
+
+/*
+ *	int32_t sched_add_kthread(void (*entry)(int32_t))
+ *  	Inputs: entry - function the task runs, must not return
+ *  	Return Value: 0 on success, -1 if out of memory
+ *		Function: Queues a task with no terminal. Like idle it keeps
+ *				  whatever program's page directory was loaded, so it
+ *				  must only touch kernel memory.
+ */
+int32_t sched_add_kthread(void (*entry)(int32_t)){
+	process_t* new_process;
+	uint32_t flags;
+
+	new_process = task_create(IDLE_TERMINAL, entry);
+	if(new_process == NULL)
+		return -1;
+
+	cli_and_save(flags);
+	enqueue(&active_queue, new_process);
+	restore_flags(flags);
+	return 0;
+}
 
 /*
  *	void scheduler()
  *  	Inputs: none
  *  	Return Value: none
- *		Function: Called be the pit to schedule programs (DOES NOT WORK)
+ *		Function: Called by the pit with interrupts off, after the EOI.
+ *				  Round robin with O(1) active/expired queues: the task
+ *				  that used its quantum goes on the expired queue and
+ *				  the next active task runs. When every task has had a
+ *				  turn the queues swap. The idle task is never queued.
  */
 void scheduler(){
-	/* save the scheduling esp to start next process at the correct location */
-	asm volatile("				\n\
-		cli						\n\
-		movl %%esp, %0"  		
-		: "=a"(sched_esp)
-		:
-		: "cc" );
-
-	disable_irq(PIT);  //disable the pit
-	send_eoi(PIT);
-	/* remove first node of run_queue */ 
-	process_t* cur_process = run_queue;  // save the current process
-	if(cur_process != NULL){ 
-		run_queue = run_queue->next;	  // set the new head
-		cur_process->next = NULL;			
-	
-	
-		/* if process is not done, add to expired queue */
-		if(!cur_process->finished){
-			if(expired_queue == NULL){		// if empty, set the process as the head
-				expired_queue = cur_process;
-			} else {						// else traverse till the end
-				process_t* temp = expired_queue;
-				while(temp->next != NULL){
-					temp = temp->next;
-				}
-				temp->next = cur_process;  // put the node at the end
-			}
-		}	
-
-		/* if there are no processes to schedule, return  */
-		if(run_queue == NULL && expired_queue == NULL){
-			sti();
-			enable_irq(PIT);
-			return;
-		}
+	process_t* prev = running;
+	process_t* next;
 
-		/* Swap queues when rotation is complete */
-		if(run_queue == NULL && expired_queue == NULL){
-			process_t* temp = run_queue;
-		 	run_queue = expired_queue;
-		 	expired_queue = temp;
-		}
-	}
-	tss.ss0 = KERNEL_DS;
-	tss.esp0 = 0x800000 - (run_queue->curr->pid + 1) * MAX_STACK;		
+	if(prev == NULL)
+		return;
+
+	/* nothing else to run */
+	next = pick_next();
+	if(next == NULL)
+		return;
+
+	if(prev != idle)
+		enqueue(&expired_queue, prev);
+	sched_switch(prev, next);
+}
 
-	/* load the process page directory and esp and ebp */
-	asm volatile("					\n\
-		movl 	%0, %%ebp		\n\
-		movl 	%1, %%esp		\n\
-		movl	%2, %%cr3		\n\
-		"
-		:
-		: "r"(run_queue->curr->curr_ebp), "r"(run_queue->curr->curr_esp), "r"(run_queue->curr->curr_pd)
-		: "memory");
-	
-	return;
+/*
+ *	int32_t sleep_on(wait_queue_t* queue)
+ *  	Inputs: queue - queue to wait on
+ *  	Return Value: 0 after a wake_one/wake_all on the queue, -1 at once
+ *				  if there is no task to block (boot, idle)
+ *		Function: Blocks the running task and runs the next one, or the
+ *				  idle task if every task is asleep. Call with interrupts
+ *				  off after checking the condition being waited for, so
+ *				  a wakeup can't be lost in between, and check it again
+ *				  on return.
+ */
+int32_t sleep_on(wait_queue_t* queue){
+	process_t* prev = running;
+	process_t* next;
+
+	if(prev == NULL || prev == idle)
+		return -1;
+
+	enqueue(queue, prev);
+	next = pick_next();
+	if(next == NULL)
+		next = idle;
+	sched_switch(prev, next);
+	return 0;
+}
+
+/*
+ *	void wake_one(wait_queue_t* queue)
+ *  	Inputs: queue - queue to wake from
+ *  	Return Value: none
+ *		Function: Makes the longest waiting task runnable again. It runs
+ *				  at the tail of the active queue, safe from interrupts.
+ */
+void wake_one(wait_queue_t* queue){
+	process_t* process;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	process = dequeue(queue);
+	if(process != NULL)
+		enqueue(&active_queue, process);
+	restore_flags(flags);
 }
 
 /*
- *	void add_prog_to_queue(pcb_t* pcb_loc)
- *  	Inputs: pcb_loc - pcb of the current process
+ *	void wake_all(wait_queue_t* queue)
+ *  	Inputs: queue - queue to wake from
  *  	Return Value: none
- *		Function: Adds the process's pcb to the run queue
- */
-void add_prog_to_queue(pcb_t* pcb_loc){
-	process_t* new_process;       	// create pointer to new process
-	process_t* temp = run_queue;	// create temp pointer for traversing the list			
-	new_process->curr = pcb_loc;
-	new_process->finished = 0;
-	new_process->next = NULL; 
-	/* if there are no processes, make this the head */
-	if(run_queue == NULL)
-		run_queue = new_process;  
-	else {   /* else put it at the end */
-		while(temp->next != NULL){    
-			temp = temp->next;
+ *		Function: Makes every task waiting on the queue runnable again.
+ */
+void wake_all(wait_queue_t* queue){
+	process_t* process;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	while((process = dequeue(queue)) != NULL)
+		enqueue(&active_queue, process);
+	restore_flags(flags);
+}
+
+/*
+ *	void terminal_main(int32_t terminal)
+ *  	Inputs: terminal - terminal this task belongs to
+ *  	Return Value: never returns
+ *		Function: Keeps a shell running on the terminal. Waits for a
+ *				  timer tick instead of spinning with interrupts off
+ *				  when there is no memory for one.
+ */
+void terminal_main(int32_t terminal){
+	switch_start = 0;			// a first run is not a resumed switch
+
+	while(1){
+		if(!can_execute()){
+			sti();
+			asm volatile("hlt");
+			continue;
 		}
-		temp->next = new_process;
+		execute((uint8_t*)"shell");
+		printk("Relaunching Shell... \n");
 	}
 }
 
 /*
- *	void remove_prog_from_queue()
+ *	void sched_stats()
  *  	Inputs: none
  *  	Return Value: none
- *		Function: set the state of the current process to finished 
+ *		Function: Prints context switch latency in cycles.
  */
-void remove_prog_from_queue(){
-	run_queue->finished = 1;  
+void sched_stats(void){
+	printf("context switches: %u, cycles last %u min %u avg %u max %u\n",
+		switch_stats.count, switch_stats.last,
+		switch_stats.count ? switch_stats.min : 0, switch_stats.avg, switch_stats.max);
 }
 
+/*
+ *	void sched_get_stats(switch_stats_t* stats)
+ *  	Inputs: stats - where the counters go
+ *  	Return Value: none
+ *		Function: Copies the context switch latency counters.
+ */
+void sched_get_stats(switch_stats_t* stats){
+	uint32_t flags;
 
-
+	cli_and_save(flags);
+	*stats = switch_stats;
+	restore_flags(flags);
+}
@@ -6,34 +6,92 @@
 #include "lib.h"
 #include "pit.h"
 #include "pcb.h"
+#include "slab.h"
+#include "timer.h"
 
 #define MAX_PROGS 3
 #define PROCESS_1 0
 #define PROCESS_2 1
 #define PROCESS_3 2
 
-void add_prog_to_queue();
+/* Scheduler quantum, SCHED_HZ quanta a second */
+#ifndef SCHED_HZ
+#define SCHED_HZ 100
+#endif
+#define SCHED_TICKS (TIMER_HZ / SCHED_HZ)		// timer ticks per quantum
+
+/* terminal of kernel tasks like idle and klogd, which run no programs */
+#define IDLE_TERMINAL -1
 
-void remove_prog_from_queue();
+/* Flags a task first runs with: reserved bit 1 set, interrupts off */
+#define INIT_EFLAGS 0x2
 
-void scheduler();
+/* Context switch latency, moving average weight of 1/16 */
+#define SWITCH_AVG_SHIFT 4
 
-/* Contains the pcb for current process, flag for finished, and ptr to next process */
+/*
+	One schedulable task per terminal. The terminal's programs all run
+	on it: the top program runs, its parents wait inside execute.
+	switch_to leaves the task's registers on its kernel stack, the first
+	three fields are read from switch.S and must stay in this order.
+*/
 typedef struct process {
-	struct pcb* curr;
-	int32_t finished;
-	struct process* next;
+	uint32_t esp;					// kernel esp, switch_to's saved frame on top
+	uint32_t pd;					// page directory loaded when switched out
+	uint32_t esp0;					// tss.esp0 for the program the task returns to
+	int32_t terminal;				// terminal whose programs this task runs
+	uint32_t kstack;				// stack for terminal_main, 0 for the boot stack
+	struct process* next;			// next task in its queue
 } process_t;
 
+/* Context switch latency in cycles, from switch_to's call to its return in the next task */
+typedef struct switch_stats {
+	uint32_t count;
+	uint32_t last;
+	uint32_t min;
+	uint32_t max;
+	uint32_t avg;
+} switch_stats_t;
+
+/* FIFO of tasks, tail pointer for O(1) enqueue */
+typedef struct sched_queue {
+	process_t* head;
+	process_t* tail;
+} sched_queue_t;
+
+/* Tasks blocked until a wake_one/wake_all, same FIFO as the run queues */
+typedef sched_queue_t wait_queue_t;
+#define WAIT_QUEUE_INIT {NULL, NULL}
 
+/* Makes the boot stack terminal 1's task */
+void sched_init(void);
 
+/* Creates the task for a terminal, which starts a shell when first run */
+int32_t sched_add_terminal(int32_t terminal);
 
+/* Creates and queues a kernel task, entry must not return */
+int32_t sched_add_kthread(void (*entry)(int32_t));
 
-//void init_shells();
+/* Called on every PIT tick, switches to the next task */
+void scheduler(void);
 
-//extern int32_t restore_flag;
+/* Wait queues, call sleep_on with interrupts off. sleep_on fails when
+ * there is no task to block. */
+int32_t sleep_on(wait_queue_t* queue);
+void wake_one(wait_queue_t* queue);
+void wake_all(wait_queue_t* queue);
 
+/* Body of every terminal task, keeps a shell running */
+void terminal_main(int32_t terminal);
+
+/* Saves prev's registers, resumes next (switch.S) */
+void switch_to(process_t* prev, process_t* next);
+
+/* Prints context switch latency */
+void sched_stats(void);
+void sched_get_stats(switch_stats_t* stats);
 
 #endif
 
 
+
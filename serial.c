@@ -0,0 +1,320 @@
+#include "serial.h"
+#include "sched.h"
+
+/**
+***	Local Variable:
+**/
+
+/* Bytes waiting for the transmitter. Positions run freely and are masked
+ * on use, so head - tail is the fill level. */
+static uint8_t tx_ring[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;						// next byte queued goes here
+static uint32_t tx_tail = 0;						// next byte sent comes from here
+static uint32_t tx_busy = 0;						// a tx interrupt will come for the fifo in flight
+static wait_queue_t tx_queue = WAIT_QUEUE_INIT;		// tasks waiting for room in the ring
+
+/* Bytes received and not read yet */
+static uint8_t rx_ring[SERIAL_RX_SIZE];
+static uint32_t rx_head = 0;
+static uint32_t rx_tail = 0;
+static wait_queue_t rx_queue = WAIT_QUEUE_INIT;
+
+static uint32_t serial_ready = 0;
+
+/**
+***	Serial Initialization and Handling:
+**/
+
+/*
+ *	void serial_init();
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Sets COM1 to 115200 baud 8N1 with its fifos on and
+ *				  interrupts for received bytes and an empty transmitter.
+ *				  IRQ4 still has to be unmasked.
+ */
+void serial_init()
+{
+	outb(0, COM1 + COM_IER);							// quiet while it is set up
+	outb(LCR_DLAB, COM1 + COM_LCR);						// divisor latch
+	outb(COM_DIVISOR & 0xFF, COM1 + COM_DATA);
+	outb(COM_DIVISOR >> 8, COM1 + COM_IER);
+	outb(LCR_8N1, COM1 + COM_LCR);
+	outb(FCR_ENABLE, COM1 + COM_FCR);
+	outb(MCR_DTR_RTS | MCR_OUT2, COM1 + COM_MCR);
+	inb(COM1 + COM_LSR);								// clear anything pending from the bios
+	inb(COM1 + COM_DATA);
+	inb(COM1 + COM_IIR);
+	outb(IER_RX | IER_TX | IER_LINE, COM1 + COM_IER);
+	serial_ready = 1;
+}
+
+/*
+ *	void tx_fill();
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Moves up to a fifo's worth of queued bytes into the
+ *				  UART and wakes tasks waiting for room in the ring. Only
+ *				  called with the fifo empty and interrupts off.
+ */
+static void tx_fill()
+{
+	uint32_t n = UART_FIFO;
+
+	tx_busy = (tx_tail != tx_head);
+	while (n-- > 0 && tx_tail != tx_head)
+	{
+		outb(tx_ring[tx_tail++ & (SERIAL_TX_SIZE - 1)], COM1 + COM_DATA);
+	}
+	if (tx_busy)
+	{
+		wake_all(&tx_queue);
+	}
+}
+
+/*
+ *	void tx_wait();
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Sleeps until the tx ring has room, so a task never polls
+ *				  the UART with interrupts off. Called with interrupts off.
+ *				  Returns at once if there is no task to block (boot,
+ *				  idle), serial_putc then polls instead.
+ */
+static void tx_wait()
+{
+	while (serial_ready && tx_head - tx_tail == SERIAL_TX_SIZE)
+	{
+		if (sleep_on(&tx_queue) == -1)
+		{
+			return;
+		}
+	}
+}
+
+/*
+ *	void serial_handler();
+ *  	Inputs: void
+ *  	Return Value: none
+ *		Function: Handles COM1 interrupts until the UART has none left.
+ *				  Refills the tx fifo, stores received bytes and wakes
+ *				  readers. Bytes arriving with the rx ring full are dropped.
+ */
+void serial_handler()
+{
+	uint8_t iir, c;
+
+	while (!((iir = inb(COM1 + COM_IIR)) & IIR_NONE))
+	{
+		switch (iir & IIR_ID_MASK)
+		{
+			case IIR_TX:
+				tx_fill();
+				break;
+			case IIR_RX:
+			case IIR_TIMEOUT:
+				while (inb(COM1 + COM_LSR) & LSR_DR)
+				{
+					c = inb(COM1 + COM_DATA);
+					if (rx_head - rx_tail < SERIAL_RX_SIZE)
+					{
+						rx_ring[rx_head++ & (SERIAL_RX_SIZE - 1)] = c;
+					}
+				}
+				wake_all(&rx_queue);
+				break;
+			case IIR_LINE:
+				inb(COM1 + COM_LSR);					// reading it clears the error
+				break;
+			default:
+				inb(COM1 + COM_MSR);					// reading it clears the change
+				break;
+		}
+	}
+	send_eoi(SERIAL);
+}
+
+/**
+***	Kernel Output:
+**/
+
+/*
+ *	void serial_putc(uint8_t c);
+ *  	Inputs: c - byte to send
+ *  	Return Value: none
+ *		Function: Queues a byte for the transmitter and returns. Safe
+ *				  from interrupt handlers and during boot. Only a full
+ *				  ring waits, and then just for the oldest byte to go out
+ *				  by polling. Tasks go through serial_puts or serial_send,
+ *				  which sleep for room instead.
+ */
+void serial_putc(uint8_t c)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	if (!serial_ready)
+	{
+		restore_flags(flags);
+		return;
+	}
+	if (tx_head - tx_tail == SERIAL_TX_SIZE)
+	{
+		while (!(inb(COM1 + COM_LSR) & LSR_THRE));
+		outb(tx_ring[tx_tail++ & (SERIAL_TX_SIZE - 1)], COM1 + COM_DATA);
+	}
+	tx_ring[tx_head++ & (SERIAL_TX_SIZE - 1)] = c;
+	if (!tx_busy)
+	{
+		tx_fill();										// idle, nothing else will start it
+	}
+	restore_flags(flags);
+}
+
+/*
+ *	void serial_puts(const int8_t* s);
+ *  	Inputs: s - string to send
+ *  	Return Value: none
+ *		Function: Queues a string, newlines go out as CR LF for terminals.
+ *				  Sleeps while the ring is full, so only for tasks.
+ */
+void serial_puts(const int8_t* s)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	while (*s != '\0')
+	{
+		if (*s == '\n')
+		{
+			tx_wait();
+			serial_putc('\r');
+		}
+		tx_wait();
+		serial_putc(*s++);
+	}
+	restore_flags(flags);
+}
+
+/*
+ *	void serial_send(const void* data, uint32_t len);
+ *  	Inputs: data - bytes to send
+ *				len - how many
+ *  	Return Value: none
+ *		Function: Queues binary data as is. Sleeps while the ring is
+ *				  full, so only for tasks.
+ */
+void serial_send(const void* data, uint32_t len)
+{
+	const uint8_t* bytes = data;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	while (len-- > 0)
+	{
+		tx_wait();
+		serial_putc(*bytes++);
+	}
+	restore_flags(flags);
+}
+
+/*
+ *	int32_t serial_lookup(const uint8_t* fname, dentry_t* dentry);
+ *  	Inputs: fname - file name
+ *				dentry - dentry to fill in
+ *   	Return Value: 0 if fname is the serial device, -1 otherwise
+ *		Function: Lets open find the device like any other file.
+ */
+int32_t serial_lookup(const uint8_t* fname, dentry_t* dentry)
+{
+	if (strncmp((const int8_t*)fname, SERIAL_NAME, NAME_SIZE) != 0)
+	{
+		return -1;
+	}
+	memset(dentry, 0, sizeof(dentry_t));
+	strncpy((int8_t*)dentry->name, SERIAL_NAME, NAME_SIZE);
+	dentry->type = SERIAL_TYPE;
+	return 0;
+}
+
+/**
+***	Serial System Calls:
+**/
+
+/*
+ *	int32_t serial_open(const uint8_t * filename);
+ *  	Inputs: filename - unused
+ *   	Return Value: 0
+ *		Function: Nothing to set up, the UART is shared by every fd.
+ */
+int32_t serial_open(const uint8_t * filename)
+{
+	return 0;
+}
+
+/*
+ *	int32_t serial_read(int32_t fd, char * buf, int32_t nbytes);
+ *  	Inputs: fd - file descriptor
+ *				buf - where the bytes go
+ *				nbytes - most bytes to read
+ *   	Return Value: bytes read, -1 on a bad buffer
+ *		Function: Sleeps until at least one byte has arrived, then
+ *				  returns what is there up to nbytes.
+ */
+int32_t serial_read(int32_t fd, char * buf, int32_t nbytes)
+{
+	int32_t bytes_read = 0;
+	uint32_t flags;
+
+	if (buf == NULL || nbytes < 0)
+	{
+		return -1;
+	}
+	if (nbytes == 0)
+	{
+		return 0;
+	}
+
+	cli_and_save(flags);
+	while (rx_head == rx_tail)							// other tasks run meanwhile
+	{
+		sleep_on(&rx_queue);
+	}
+	while (bytes_read < nbytes && rx_tail != rx_head)
+	{
+		buf[bytes_read++] = rx_ring[rx_tail++ & (SERIAL_RX_SIZE - 1)];
+	}
+	restore_flags(flags);
+	return bytes_read;
+}
+
+/*
+ *	int32_t serial_write(int32_t fd, const char * buf, int32_t nbytes);
+ *  	Inputs: fd - file descriptor
+ *				buf - bytes to send
+ *				nbytes - how many
+ *   	Return Value: nbytes, -1 on a bad buffer
+ *		Function: Queues the bytes unchanged, so binary dumps survive.
+ *				  Sleeps while the ring is full, other tasks and
+ *				  interrupts run meanwhile.
+ */
+int32_t serial_write(int32_t fd, const char * buf, int32_t nbytes)
+{
+	if (buf == NULL || nbytes < 0)
+	{
+		return -1;
+	}
+	serial_send(buf, nbytes);
+	return nbytes;
+}
+
+/*
+ *	int32_t serial_close(int32_t fd);
+ *  	Inputs: fd - file descriptor
+ *   	Return Value: 0
+ *		Function: Nothing to tear down.
+ */
+int32_t serial_close(int32_t fd)
+{
+	return 0;
+}
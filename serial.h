@@ -0,0 +1,69 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "i8259.h"
+#include "lib.h"
+#include "filesys.h"
+
+/* 16550 UART on COM1 */
+#define SERIAL 0x04					// irq line
+#define COM1 0x3F8
+#define COM_DATA 0					// rx/tx holding register, divisor low with DLAB
+#define COM_IER 1					// interrupt enable, divisor high with DLAB
+#define COM_IIR 2					// interrupt id on read
+#define COM_FCR 2					// fifo control on write
+#define COM_LCR 3
+#define COM_MCR 4
+#define COM_LSR 5
+#define COM_MSR 6
+
+#define IER_RX 0x01					// data available
+#define IER_TX 0x02					// transmit holding register empty
+#define IER_LINE 0x04				// line status
+#define LCR_DLAB 0x80
+#define LCR_8N1 0x03
+#define FCR_ENABLE 0xC7				// enable and clear the fifos, 14 byte rx trigger
+#define MCR_DTR_RTS 0x03
+#define MCR_OUT2 0x08				// gates the uart's interrupt onto the irq line
+#define LSR_DR 0x01					// a received byte is waiting
+#define LSR_THRE 0x20				// transmit holding register empty
+#define IIR_NONE 0x01				// no interrupt pending
+#define IIR_ID_MASK 0x0E
+#define IIR_MODEM 0x00
+#define IIR_TX 0x02
+#define IIR_RX 0x04
+#define IIR_LINE 0x06
+#define IIR_TIMEOUT 0x0C			// bytes sat in the rx fifo below the trigger
+#define COM_DIVISOR 1				// 115200 baud
+#define UART_FIFO 16				// bytes the tx fifo takes at once
+
+/* Ring sizes, powers of two */
+#define SERIAL_TX_SIZE 4096
+#define SERIAL_RX_SIZE 256
+
+/* The serial device as a file, found by name like the boot image's files */
+#define SERIAL_TYPE 4
+#define SERIAL_NAME "serial"
+
+/* Serial Initialization */
+void serial_init(void);
+
+/* Serial Handler */
+void serial_handler(void);
+
+/* Kernel output, queued for the transmitter. serial_putc polls when the
+ * queue is full and works anywhere, the others sleep and need a task. */
+void serial_putc(uint8_t c);
+void serial_puts(const int8_t* s);
+void serial_send(const void* data, uint32_t len);
+
+/* Dentry of the serial device, same contract as read_dentry_by_name */
+int32_t serial_lookup(const uint8_t* fname, dentry_t* dentry);
+
+/* Serial System Calls */
+int32_t serial_open(const uint8_t * filename);
+int32_t serial_read(int32_t fd, char * buf, int32_t nbytes);
+int32_t serial_write(int32_t fd, const char * buf, int32_t nbytes);
+int32_t serial_close(int32_t fd);
+
+#endif
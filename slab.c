@@ -0,0 +1,207 @@
+/**
+***	slab.c: Object caches for fixed-size kernel objects.
+**/
+
+#include "slab.h"
+#include "frame.h"
+#include "lib.h"
+#include "sched.h"
+#include "pcb.h"
+
+/* Per-type caches */
+slab_cache_t process_cache = SLAB_CACHE("process_t", sizeof(process_t));
+slab_cache_t pcb_cache = SLAB_CACHE("pcb_t", sizeof(pcb_t));
+slab_cache_t fd_cache = SLAB_CACHE("fd table", sizeof(fd_entry_t) * FOPS_NUM);
+
+/* kmalloc size classes, each twice the last */
+static slab_cache_t kmalloc_cache[KMALLOC_CLASSES] = {
+	SLAB_CACHE("kmalloc-32", 32),
+	SLAB_CACHE("kmalloc-64", 64),
+	SLAB_CACHE("kmalloc-128", 128),
+	SLAB_CACHE("kmalloc-256", 256),
+	SLAB_CACHE("kmalloc-512", 512),
+	SLAB_CACHE("kmalloc-1024", 1024),
+	SLAB_CACHE("kmalloc-2048", 2048)
+};
+
+/* Every cache, for slab_stats */
+static slab_cache_t* const slab_caches[] = {
+	&process_cache, &pcb_cache, &fd_cache,
+	&kmalloc_cache[0], &kmalloc_cache[1], &kmalloc_cache[2], &kmalloc_cache[3],
+	&kmalloc_cache[4], &kmalloc_cache[5], &kmalloc_cache[6]
+};
+
+/*
+ * slab_grow
+ * Adds one slab of objects to a cache
+ * INPUTS: cache - cache that ran out of free objects
+ * OUTPUTS: 0 on success, -1 if no frame is left
+ * EFFECTS: The frame is reached through the kernel direct map. Every
+ *			object in it is pushed on the free list.
+ */
+static int32_t slab_grow(slab_cache_t* cache)
+{
+	slab_t* slab;
+	uint8_t* obj;
+	uint8_t* end;
+
+	slab = (slab_t*)frame_alloc();
+	if (slab == NULL)
+	{
+		return -1;
+	}
+
+	slab->cache = cache;
+	obj = (uint8_t*)(slab + 1);
+	end = (uint8_t*)slab + SLAB_SIZE;
+	for (; obj + cache->obj_size <= end; obj += cache->obj_size)
+	{
+		*(void**)obj = cache->free_list;
+		cache->free_list = obj;
+		cache->total++;
+	}
+	cache->slabs++;
+
+	return 0;
+}
+
+/*
+ * cache_alloc
+ * Takes an object from a cache
+ * INPUTS: cache - cache for the object type
+ * OUTPUTS: pointer to the object, NULL when out of memory
+ * EFFECTS: Pops the free list, growing the cache by a slab when it is
+ *			empty. The object is not cleared. Safe from interrupt context.
+ */
+void* cache_alloc(slab_cache_t* cache)
+{
+	uint32_t flags;
+	void* obj;
+
+	cli_and_save(flags);
+	if (cache->free_list == NULL && slab_grow(cache) == -1)
+	{
+		cache->fails++;
+		restore_flags(flags);
+		return NULL;
+	}
+
+	obj = cache->free_list;
+	cache->free_list = *(void**)obj;
+	cache->in_use++;
+	cache->allocs++;
+	restore_flags(flags);
+
+	return obj;
+}
+
+/*
+ * cache_free
+ * Returns an object to its cache
+ * INPUTS: cache - cache the object came from
+ *		   obj - object from cache_alloc, may be NULL
+ * OUTPUTS: none
+ * EFFECTS: Pushes the object on the free list. Slabs are kept for reuse
+ *			rather than handed back to the frame allocator.
+ */
+void cache_free(slab_cache_t* cache, void* obj)
+{
+	uint32_t flags;
+
+	if (obj == NULL)
+	{
+		return;
+	}
+
+	cli_and_save(flags);
+	*(void**)obj = cache->free_list;
+	cache->free_list = obj;
+	cache->in_use--;
+	restore_flags(flags);
+}
+
+/*
+ * kmalloc
+ * Allocates kernel memory from the smallest size class that fits
+ * INPUTS: size - bytes needed
+ * OUTPUTS: pointer to the memory, NULL if size is 0, larger than
+ *			KMALLOC_MAX, or memory is exhausted
+ * EFFECTS: Larger buffers should come straight from the frame allocator.
+ */
+void* kmalloc(uint32_t size)
+{
+	uint32_t i;
+	uint32_t class_size = KMALLOC_MIN;
+
+	if (size == 0)
+	{
+		return NULL;
+	}
+
+	for (i = 0; i < KMALLOC_CLASSES; i++, class_size <<= 1)
+	{
+		if (size <= class_size)
+		{
+			return cache_alloc(&kmalloc_cache[i]);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * kfree
+ * Frees memory from kmalloc or any cache_alloc
+ * INPUTS: obj - object to free, may be NULL
+ * OUTPUTS: none
+ * EFFECTS: The owning cache is read from the slab header at the start of
+ *			the object's frame.
+ */
+void kfree(void* obj)
+{
+	if (obj == NULL)
+	{
+		return;
+	}
+
+	cache_free(((slab_t*)((uint32_t)obj & SLAB_MASK))->cache, obj);
+}
+
+/*
+ * slab_cache_at
+ * Walks the caches
+ * INPUTS: index - position in the cache list
+ * OUTPUTS: the cache, NULL past the last one
+ * EFFECTS: none
+ */
+slab_cache_t* slab_cache_at(uint32_t index)
+{
+	if (index >= sizeof(slab_caches) / sizeof(slab_caches[0]))
+	{
+		return NULL;
+	}
+	return slab_caches[index];
+}
+
+/*
+ * slab_stats
+ * Prints usage for every cache
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: One line per cache: object size, objects in use out of the
+ *			objects carved, slabs (frames) held, allocations and failures.
+ */
+void slab_stats(void)
+{
+	uint32_t i;
+	slab_cache_t* cache;
+
+	printf("cache: size used/total slabs allocs fails\n");
+	for (i = 0; i < sizeof(slab_caches) / sizeof(slab_caches[0]); i++)
+	{
+		cache = slab_caches[i];
+		printf("%s: %u  %u/%u  %u  %u  %u\n", cache->name, cache->obj_size,
+			cache->in_use, cache->total, cache->slabs, cache->allocs, cache->fails);
+	}
+	printf("free frames: %u\n", frame_free_count());
+}
@@ -0,0 +1,55 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "types.h"
+
+/* Slab Constants */
+#define SLAB_SIZE		4096		// every slab is one frame
+#define SLAB_MASK		0xFFFFF000	// slab header is at the start of the frame
+#define SLAB_ALIGN		4
+#define KMALLOC_MIN		32			// smallest kmalloc size class
+#define KMALLOC_CLASSES	7			// 32, 64, ... 2048 bytes
+#define KMALLOC_MAX		(KMALLOC_MIN << (KMALLOC_CLASSES - 1))
+
+/* Object cache, one per object type or kmalloc size class */
+typedef struct slab_cache {
+	const char* name;
+	uint32_t obj_size;				// rounded up to SLAB_ALIGN, holds a free-list link
+	void* free_list;				// free objects, linked through their first word
+	uint32_t in_use;				// objects handed out
+	uint32_t total;					// objects carved from slabs
+	uint32_t slabs;					// frames backing the cache
+	uint32_t allocs;				// successful allocations, ever
+	uint32_t fails;					// allocations refused for lack of frames
+} slab_cache_t;
+
+/* Header at the start of every slab frame */
+typedef struct slab {
+	slab_cache_t* cache;			// lets kfree find the cache from the address
+	uint32_t reserved[3];			// pads the header to 16 bytes, objects are SLAB_ALIGN aligned
+} slab_t;
+
+/* Static initializer for a cache of objects of the given size */
+#define SLAB_CACHE(cache_name, size)	\
+	{ (cache_name), (((size) < sizeof(void*) ? sizeof(void*) : (size)) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1), NULL, 0, 0, 0, 0, 0 }
+
+/* Per-type caches */
+extern slab_cache_t process_cache;	// scheduler nodes
+extern slab_cache_t pcb_cache;		// process control blocks
+extern slab_cache_t fd_cache;		// file descriptor tables
+
+/* Object cache allocation, O(1) unless a new slab is needed */
+void* cache_alloc(slab_cache_t* cache);
+void cache_free(slab_cache_t* cache, void* obj);
+
+/* General purpose allocation from the size class caches */
+void* kmalloc(uint32_t size);
+void kfree(void* obj);
+
+/* Prints usage for every cache */
+void slab_stats(void);
+
+/* Every cache in turn, NULL past the last */
+slab_cache_t* slab_cache_at(uint32_t index);
+
+#endif
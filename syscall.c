@@ -1,9 +1,18 @@
 #include "syscall.h"
+#include "sched.h"
+#include "timer.h"
+#include "sysfs.h"
+#include "trace.h"
+#include "klog.h"
  
 pcb_t* pcb_loc[NUMTERMINALS] = {(pcb_t*) PCB0_LOC, NULL, NULL}; // location of the current pcb in memory
 static pcb_t * prev_pcb[NUMTERMINALS] = {NULL, NULL, NULL}; // init to NULL
-int32_t memoryspace[MAX_PROCESSES] = {0,0,0,0,0,0};
+int32_t memoryspace[MAX_PROCESSES] = {0};
 int32_t prog_count[NUMTERMINALS] = {0, 0, 0}; // keeps track of number of terminals
+static int32_t sysenter_enabled = 0;
+int32_t syscall_stats_on = 0;								// read by DISPATCH in wrapper.S
+static syscall_stat_t syscall_stats[SYSCALL_COUNT];
+static uint32_t sysenter_stack[SYSENTER_STACK];
 
 //File open jump table
 int32_t (*fs_jmp_table[JMPTABLE_SIZE])() = {
@@ -45,29 +54,73 @@ int32_t (*rtc_jmp_table[JMPTABLE_SIZE])() = {
         &rtc_close
 };
  
+//serial jump table
+int32_t (*serial_jmp_table[JMPTABLE_SIZE])() = {
+        &serial_open,
+        &serial_read,
+        &serial_write,
+        &serial_close
+};
+ 
+/*  can_execute
+ *  INPUTS: none
+ *  OUTPUTS: 1 if a new program can be started, 0 otherwise
+ *  NOTES: A program needs a free pid and enough free frames
+ *          for its page tables, PCB and first pages.
+ */
+int32_t can_execute(void)
+{
+    uint32_t i;
+
+    if(frame_free_count() < EXEC_MIN_FRAMES){
+        return 0;
+    }
+    for(i = 0; i < MAX_PROCESSES; i++){
+        if(memoryspace[i] == 0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*  halt
  *  INPUTS: status
  *  OUTPUTS: returns 0 on success    
+ *  NOTES: system call wrapper for halt_status
+ */  
+int32_t halt(uint8_t status)
+{
+    return halt_status(status);
+}
+
+/*  halt_status
+ *  INPUTS: status: value execute returns to the parent,
+ *          EXCEPTION_STATUS if the program was killed
+ *  OUTPUTS: returns 0 on success    
  *  NOTES: halts the current program by switching
  *          stacks, esp, and ebp.
  *          All open files are also closed upon  
  */  
-int32_t halt(uint8_t status)
+int32_t halt_status(uint32_t status)
 {
     int8_t i;
 
+    TRACE(TR_HALT, status);
+    if (pcb_loc[sched_terminal]->vga_pinned)
+        vga_unpin(sched_terminal);
+
     // close all files
     for(i = 2; i< FOPS_NUM; i++){
         close(i);
     }
 
     //reduce task_count and restore values to ebp/esp
-    prog_count[current_terminal]--;
-    memoryspace[pcb_loc[current_terminal]->pid] = 0;
+    prog_count[sched_terminal]--;
+    memoryspace[pcb_loc[sched_terminal]->pid] = 0;
     tss.ss0 = KERNEL_DS;
-    pcb_loc[current_terminal]->status  = status;
+    pcb_loc[sched_terminal]->status  = status;
     // set esp0 to correct stack position
-    tss.esp0 = _8MB - (pcb_loc[current_terminal]->lastpcb_ptr->pid + 1) * MAX_STACK;
+    tss.esp0 = PCB_STACK_TOP(pcb_loc[sched_terminal]->lastpcb_ptr);
     
     asm volatile("                                  \n\
                     movl    %0, %%ebp               \n\
@@ -76,7 +129,7 @@ int32_t halt(uint8_t status)
                     jmp halt_ret                    \n\
                     "
                     :
-                    : "r"(pcb_loc[current_terminal]->ebp), "r"(pcb_loc[current_terminal]->esp), "r"(pcb_loc[current_terminal]->pagedir)
+                    : "r"(pcb_loc[sched_terminal]->ebp), "r"(pcb_loc[sched_terminal]->esp), "r"(pcb_loc[sched_terminal]->pagedir)
                     : "memory");
     return 0;
 }
@@ -93,8 +146,6 @@ int32_t halt(uint8_t status)
 int32_t execute(const uint8_t* command)
 {
  
-        uint8_t elfbuf[ELF_SIZE];       //elf buffer is bytes 0-8 of file
-        uint8_t addrbuf[BUFFASIZE];     //address buffer is bytes 24-27 of file
         uint8_t argbuf[BUFFASIZE];      //argument buffer
         uint8_t prgname[BUFFASIZE];     //name of program
         uint32_t i=0;
@@ -103,16 +154,22 @@ int32_t execute(const uint8_t* command)
         uint32_t arg_length=0;  //argument length      
         uint32_t entryaddr=0;   //entry point
         dentry_t curr_dentry;
+        elf_image_t image;      //parsed executable
+        pcb_t* child;           //pcb of the new program
  
-        //check max processes
-        if(prog_count[TERM_1] + prog_count[TERM_2] + prog_count[TERM_3] >= MAX_PROCESSES){
-            printk("MAX PROCESSES REACHED! \n");
+        TRACE(TR_EXEC_ENTER, 0);
+
+        //check for a free pid and memory
+        if(!can_execute()){
+            klog(KLOG_WARN, "execute: max processes reached");
+            TRACE(TR_EXEC_EXIT, 0);
             return 0;
         }
                 
  
         //check for invalid command
         if(command[0]=='\0' || command[0]==NULL){
+                TRACE(TR_EXEC_EXIT, -1);
                 return -1;
         }
  
@@ -131,63 +188,47 @@ int32_t execute(const uint8_t* command)
                 }
         }
  
-        //find program name in filesystem
-        if( (read_dentry_by_name(prgname, &curr_dentry))==-1 )
+        //find program name in filesystem, devices and stats files are not programs
+        if( (read_dentry_by_name(prgname, &curr_dentry))==-1 || curr_dentry.type == SYSFS_TYPE || curr_dentry.type == SERIAL_TYPE )
         {
+                TRACE(TR_EXEC_EXIT, -1);
                 return -1;
         }
  
-        //copy over first 4 bytes of file
-        if(read_data(curr_dentry.inode, 0, elfbuf, ELF_SIZE) == -1)
+        //parse the elf headers, cached after the first launch
+        if(elf_load(curr_dentry.inode, &image) == -1)
         {
+                TRACE(TR_EXEC_EXIT, -1);
                 return -1;
         }
  
-        //magic elf checks
-        if( elfbuf[0] != MAGIC0 ||
-                elfbuf[1] != MAGIC1 ||
-                elfbuf[2] != MAGIC2 ||
-                elfbuf[3] != MAGIC3)
-        {
-                return -1;
-        }
- 
-        //copy over bytes 24-27 for address
-        if(read_data(curr_dentry.inode, 0, addrbuf, BUFFASIZE)== -1)
-        {
-                return -1;
-        }      
- 
         //set entry point address
-        uint8_t a = addrbuf[BIT_A];
-        uint8_t b = addrbuf[BIT_B];
-        uint8_t c = addrbuf[BIT_C];
-        uint8_t d = addrbuf[BIT_D];
-        entryaddr = a | b << SHIFT | c<<(2*SHIFT)| d<<(3*SHIFT);
+        entryaddr = image.entry;
  
-        prog_count[current_terminal]++;
-        pcb_t new_pcb = pcb_init(); // create a new pcb
+        prog_count[sched_terminal]++;
  
         for(pger =0; pger < MAX_PROCESSES; pger++)
          {
                 if(memoryspace[pger] == 0)
                 {
-                        new_pcb.pid = pger;
                         memoryspace[pger] = 1;
                         break;
                 }
         }
 
-        //calculate PCB location
-        pcb_t* temp = pcb_loc[current_terminal];
-        pcb_loc[current_terminal] = (pcb_t*)((uint32_t)PCB0_LOC - (new_pcb.pid)*EIGHT_KB);
-        
-        if(prog_count[current_terminal] == 1)
-            prev_pcb[current_terminal] = pcb_loc[current_terminal];
-        else
-            prev_pcb[current_terminal] = temp;
+        //create a new pcb, the first on a terminal is its own parent
+        child = pcb_alloc(pger, (prog_count[sched_terminal] == 1) ? NULL : pcb_loc[sched_terminal]);
+        if(child == NULL || prog_init(pger) == -1){
+                pcb_free(child);
+                memoryspace[pger] = 0;
+                prog_count[sched_terminal]--;
+                klog(KLOG_WARN, "execute: out of memory");
+                TRACE(TR_EXEC_EXIT, -1);
+                return -1;
+        }
 
-        setup_pcb(&new_pcb, pcb_loc[current_terminal], prev_pcb[current_terminal]);
+        prev_pcb[sched_terminal] = child->lastpcb_ptr;
+        pcb_loc[sched_terminal] = child;
         
         /* save relevant esp,ebps into the pcb */
         uint32_t ebpsave = 0;
@@ -196,14 +237,14 @@ int32_t execute(const uint8_t* command)
                         : "=a"(ebpsave)
                         :
                         : "cc" );
-        pcb_loc[current_terminal]->ebp = ebpsave;
+        pcb_loc[sched_terminal]->ebp = ebpsave;
         uint32_t espsave=0;
         asm volatile(
                         "movl %%esp, %0"
                         : "=a"(espsave)
                         :
                         : "cc" );
-        pcb_loc[current_terminal]->esp = espsave; 
+        pcb_loc[sched_terminal]->esp = espsave; 
  
         //save old pagedir into pcb
         uint32_t cr3save=0;
@@ -212,7 +253,12 @@ int32_t execute(const uint8_t* command)
                         : "=a"(cr3save)
                         :
                         : "cc" );
-        pcb_loc[current_terminal]->pagedir = cr3save;
+        //a terminal's first shell may have been started on another
+        //program's stack, return to the boot directory since that
+        //program's page tables can be freed first
+        if(prog_count[sched_terminal] == 1)
+                cr3save = (uint32_t)page_directory;
+        pcb_loc[sched_terminal]->pagedir = cr3save;
         
         //save args into PCB
         for(i=namelength+1;i<BUFFASIZE;i++)
@@ -225,47 +271,29 @@ int32_t execute(const uint8_t* command)
                 else
                 {
                         argbuf[i-namelength-1]=command[i];
-                        pcb_loc[current_terminal]->args[i-namelength-1] = command[i]; // store argument into pcb
+                        pcb_loc[sched_terminal]->args[i-namelength-1] = command[i]; // store argument into pcb
                         arg_length++;
                 }
         }      
-        //allocate new memory space depending on task count.
-        if(pcb_loc[current_terminal]->pid == 0)
-                prog1_init();
-        else if(pcb_loc[current_terminal]->pid == 1)
-                prog2_init();
-        else if(pcb_loc[current_terminal]->pid == 2)
-                prog3_init();
-        else if(pcb_loc[current_terminal]->pid == 3)
-                prog4_init();
-        else if(pcb_loc[current_terminal]->pid == 4)
-                prog5_init();
-        else if(pcb_loc[current_terminal]->pid == 5)
-                prog6_init();
+        //switch to the new program's address space, vidmap shows
+        //the screen if its terminal is displayed, else its buffer
+        prog_vidmap(pcb_loc[sched_terminal]->pid, sched_terminal);
+        prog_load(pcb_loc[sched_terminal]->pid);
        
-        // copy user program into memory
-        uint32_t filelen = inode_length(curr_dentry.inode);
-        read_data(curr_dentry.inode, 0, (uint8_t *)PROGADDR, filelen);
+        // record user program for demand paging, falling back to a copy
+        if(EXEC_LOAD_MODE != LOAD_DEMAND ||
+                map_program(pcb_loc[sched_terminal]->pid, &image) == -1)
+        {
+                elf_copy(&image);
+        }
  
         // save esp into tss because intel
         tss.ss0 = KERNEL_DS;
         // calculate new kernal stack pointer
-        int32_t kern = 0x00800000 - (pcb_loc[current_terminal]->pid + 1) * MAX_STACK;
+        int32_t kern = PCB_STACK_TOP(pcb_loc[sched_terminal]);
         tss.esp0 = kern;
-        // copy "curr" into PCB, for scheduling.
-        // this isn't guarenteed to be correct
-        // copy new cr3 into PCB
-        asm volatile("movl %%cr3, %0" 
-                     : "=a"(cr3save)
-                     :
-                     : "cc" );
-
-        // save kernel stack information
-        pcb_loc[current_terminal]->curr_pd = cr3save;
-        pcb_loc[current_terminal]->curr_esp = kern;
-        pcb_loc[current_terminal]->curr_ebp = kern;
         // update terminal in which program is running to current terminal
-        pcb_loc[current_terminal]->term_num = current_terminal; 
+        pcb_loc[sched_terminal]->term_num = sched_terminal; 
         asm volatile("              \n\
                         cli                             \n\
                         movw  %0, %%ax      \n\
@@ -289,16 +317,23 @@ int32_t execute(const uint8_t* command)
                 halt_ret :      \n\
                 ");
         //store val
-        int8_t ret = pcb_loc[current_terminal]->status;
+        child = pcb_loc[sched_terminal];
+        int32_t ret = child->status;
 
         // if the status is greater than 0, program ran successfully
-        if(ret >0){
+        if(ret >0 && ret != EXCEPTION_STATUS){
             ret =0; 
         }
 
         //update PCB loc.
-        if(prog_count[current_terminal] != 0)
-            pcb_loc[current_terminal] = pcb_loc[current_terminal]->lastpcb_ptr;
+        if(prog_count[sched_terminal] != 0)
+            pcb_loc[sched_terminal] = child->lastpcb_ptr;
+
+        //back on the parent's stack and page directory, so the
+        //child's memory can go back to the frame allocator
+        prog_free(child->pid);
+        pcb_free(child);
+        TRACE(TR_EXEC_EXIT, ret);
         return ret;
 }
 
@@ -318,7 +353,7 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes)
                 return -1;
         }
  
-        if(pcb_loc[current_terminal]->file_desc[fd].flags == 0) // checks to see if it is in use
+        if(pcb_loc[sched_terminal]->file_desc[fd].flags == 0) // checks to see if it is in use
         {
                 return -1;
         }
@@ -328,7 +363,7 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes)
                 return -1;
         }
  
-        return pcb_loc[current_terminal]->file_desc[fd].fops_ptr[CALL_READ](fd, buf, nbytes);
+        return pcb_loc[sched_terminal]->file_desc[fd].fops_ptr[CALL_READ](fd, buf, nbytes);
 }
 
 /*  write
@@ -347,7 +382,7 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes)
                 return -1;
         }
  
-        if(pcb_loc[current_terminal]->file_desc[fd].flags == 0) // checks to see if it is in use
+        if(pcb_loc[sched_terminal]->file_desc[fd].flags == 0) // checks to see if it is in use
         {
                 return -1;
         }
@@ -357,7 +392,7 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes)
                 return -1;
         }
  
-        return pcb_loc[current_terminal]->file_desc[fd].fops_ptr[CALL_WRITE](fd, buf, nbytes);
+        return pcb_loc[sched_terminal]->file_desc[fd].fops_ptr[CALL_WRITE](fd, buf, nbytes);
 }
 
 /*  open
@@ -380,7 +415,7 @@ int32_t open (const uint8_t * filename)
         //find next open spot, skipping stdin/stdout
         for (i = FIRST_FDENTRY; i < FOPS_NUM; i++)
         {
-                flag = pcb_loc[current_terminal]->file_desc[i].flags;
+                flag = pcb_loc[sched_terminal]->file_desc[i].flags;
                 if (flag == 0){
                         empty = i;
                         break;
@@ -404,24 +439,35 @@ int32_t open (const uint8_t * filename)
         // file descriptors should have different metadata values depending on file type
         switch(temp_dentry.type){
                 case 0:
-                        pcb_loc[current_terminal]->file_desc[empty].fops_ptr = rtc_jmp_table;
-                        pcb_loc[current_terminal]->file_desc[empty].inode_ptr = NULL;
-                        pcb_loc[current_terminal]->file_desc[empty].fops_ptr[CALL_OPEN](filename);
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr = rtc_jmp_table;
+                        pcb_loc[sched_terminal]->file_desc[empty].inode_ptr = NULL;
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr[CALL_OPEN](filename);
                         break;
                 case 1:
-                        pcb_loc[current_terminal]->file_desc[empty].fops_ptr = dir_jmp_table;
-                        pcb_loc[current_terminal]->file_desc[empty].inode_ptr = NULL;
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr = dir_jmp_table;
+                        pcb_loc[sched_terminal]->file_desc[empty].inode_ptr = NULL;
                         break;
                 case 2:
-                        pcb_loc[current_terminal]->file_desc[empty].fops_ptr = fs_jmp_table;
-                        pcb_loc[current_terminal]->file_desc[empty].inode_ptr = temp_dentry.inode;
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr = fs_jmp_table;
+                        pcb_loc[sched_terminal]->file_desc[empty].inode_ptr = temp_dentry.inode;
+                        break;
+                case SYSFS_TYPE:
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr = sysfs_fops(temp_dentry.inode);
+                        pcb_loc[sched_terminal]->file_desc[empty].inode_ptr = temp_dentry.inode;
+                        break;
+                case SERIAL_TYPE:
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr = serial_jmp_table;
+                        pcb_loc[sched_terminal]->file_desc[empty].inode_ptr = NULL;
+                        pcb_loc[sched_terminal]->file_desc[empty].fops_ptr[CALL_OPEN](filename);
                         break;
                 default: return -1;
         }
         
         // reset file position and flags to 1, signifies in use
-        pcb_loc[current_terminal]->file_desc[empty].file_pos = 0;
-        pcb_loc[current_terminal]->file_desc[empty].flags = 1;
+        pcb_loc[sched_terminal]->file_desc[empty].file_pos = 0;
+        pcb_loc[sched_terminal]->file_desc[empty].flags = 1;
+        pcb_loc[sched_terminal]->file_desc[empty].rtc_freq = 0;
+        pcb_loc[sched_terminal]->file_desc[empty].rtc_tick = 0;
  
         return empty;  
 }
@@ -441,14 +487,16 @@ int32_t close (int32_t fd)
         }
         
         // if attempt to close unopened file, return -1
-        if(pcb_loc[current_terminal]->file_desc[fd].flags==0){
+        if(pcb_loc[sched_terminal]->file_desc[fd].flags==0){
             return -1;
         }
 
-        pcb_loc[current_terminal]->file_desc[fd].fops_ptr = NULL;
-        pcb_loc[current_terminal]->file_desc[fd].inode_ptr= NULL;
-        pcb_loc[current_terminal]->file_desc[fd].file_pos = NULL;
-        pcb_loc[current_terminal]->file_desc[fd].flags = 0;
+        pcb_loc[sched_terminal]->file_desc[fd].fops_ptr = NULL;
+        pcb_loc[sched_terminal]->file_desc[fd].inode_ptr= NULL;
+        pcb_loc[sched_terminal]->file_desc[fd].file_pos = NULL;
+        pcb_loc[sched_terminal]->file_desc[fd].flags = 0;
+        pcb_loc[sched_terminal]->file_desc[fd].rtc_freq = 0;
+        pcb_loc[sched_terminal]->file_desc[fd].rtc_tick = 0;
  
         return 0;
 }
@@ -467,11 +515,11 @@ int32_t getargs(uint8_t * buf, int32_t nbytes)
                 return -1;
         }
         //if no argument, return error
-        if(pcb_loc[current_terminal]->args[0] == 0 || pcb_loc[current_terminal]->args[0] == '%'){
+        if(pcb_loc[sched_terminal]->args[0] == 0 || pcb_loc[sched_terminal]->args[0] == '%'){
              return -1;
         }
  
-        memcpy(buf, &(pcb_loc[current_terminal]->args), nbytes);
+        memcpy(buf, &(pcb_loc[sched_terminal]->args), nbytes);
         return 0;
 }
 
@@ -492,20 +540,15 @@ int32_t vidmap (uint8_t ** screen_start)
             return -1;
     }
     
+    // the page follows the terminal, see prog_vidmap, and the screen
+    // has to stay where the page starts
     *screen_start = (uint8_t*) TEXTSCREENVIDMEM;
-
-    /* Only for scheduling
-    if(pcb_loc[current_terminal]->term_num == current_terminal){
-        *screen_start = (uint8_t*) TEXTSCREENVIDMEM; // maps user video memory to kernel video memory
-    }
-    else{
-        switch(pcb_loc[current_terminal]->term_num){
-            case 0: *screen_start = (uint8_t*) B_BUF_1;
-            case 1: *screen_start = (uint8_t*) B_BUF_2;
-            case 2: *screen_start = (uint8_t*) B_BUF_3;
-        }
+    if (!pcb_loc[sched_terminal]->vga_pinned)
+    {
+            pcb_loc[sched_terminal]->vga_pinned = 1;
+            vga_pin(sched_terminal);
     }
-    */
+
     return 0;
 }
 
@@ -531,5 +574,365 @@ int32_t sigreturn(void)
         return -1;
 }
 
+/*  sleep_wake
+ *  INPUTS: data: wait queue of the sleeping task
+ *  OUTPUTS: none
+ *  NOTES: sleep's timer function, runs in the PIT interrupt
+ */
+static void sleep_wake(uint32_t data)
+{
+        wake_all((wait_queue_t*)data);
+}
+
+/*  alarm_fire
+ *  INPUTS: data: pcb that armed the alarm
+ *  OUTPUTS: none
+ *  NOTES: alarm's timer function. Marks the alarm as fired and ends
+ *          a sleep in progress early, there are no signals to deliver
+ */
+static void alarm_fire(uint32_t data)
+{
+        pcb_t* pcb = (pcb_t*)data;
+        timer_t* timer = pcb->sleep_timer;
+
+        pcb->alarm_pending = 1;
+        if (timer != NULL && timer_cancel(timer))
+        {
+                timer->func(timer->data);
+        }
+}
+
+/*  ticks_to_ms
+ *  INPUTS: timer: timer to check
+ *  OUTPUTS: milliseconds until the timer's expiry, 0 if it has passed
+ *  NOTES: used for what sleep and alarm report back
+ */
+static int32_t ticks_to_ms(timer_t* timer)
+{
+        int32_t left = (int32_t)(timer->expires - timer_ticks);
+
+        return (left > 0) ? left * MS_PER_TICK : 0;
+}
+
+/*  sleep
+ *  INPUTS: ms: milliseconds to sleep
+ *  OUTPUTS: 0 after sleeping the full time, the milliseconds left if
+ *          the process's alarm went off first, -1 on a negative ms
+ *  NOTES: Blocks on a timer instead of polling, other tasks run
+ *          meanwhile. Sleeps at least ms, rounded up to a whole tick.
+ *          An alarm that fired while the process was not sleeping
+ *          ends the next sleep right away.
+ */
+int32_t sleep(int32_t ms)
+{
+        pcb_t* pcb = pcb_loc[sched_terminal];
+        wait_queue_t queue = WAIT_QUEUE_INIT;
+        timer_t timer;
+        uint32_t flags;
+        int32_t left = 0;
+
+        if (ms < 0)
+        {
+                return -1;
+        }
+
+        cli_and_save(flags);
+        if (pcb->alarm_pending)
+        {
+                pcb->alarm_pending = 0;
+                restore_flags(flags);
+                return ms;
+        }
+
+        // the current tick is partly over, so wait one more
+        timer.link.next = NULL;
+        timer.expires = timer_ticks + ms_to_ticks(ms) + 1;
+        timer.func = sleep_wake;
+        timer.data = (uint32_t)&queue;
+        pcb->sleep_timer = &timer;
+        timer_add(&timer);
+
+        while (timer_pending(&timer))
+        {
+                sleep_on(&queue);
+        }
+        pcb->sleep_timer = NULL;
+
+        if (pcb->alarm_pending)
+        {
+                pcb->alarm_pending = 0;
+                left = ticks_to_ms(&timer);
+        }
+        restore_flags(flags);
+        return left;
+}
+
+/*  alarm
+ *  INPUTS: ms: milliseconds until the alarm, 0 cancels it
+ *  OUTPUTS: milliseconds left on the previous alarm, 0 if there was
+ *          none, -1 on a negative ms
+ *  NOTES: One alarm per process, a new one replaces the old. With no
+ *          signal support the alarm wakes the process from sleep
+ */
+int32_t alarm(int32_t ms)
+{
+        pcb_t* pcb = pcb_loc[sched_terminal];
+        uint32_t flags;
+        int32_t left = 0;
+
+        if (ms < 0)
+        {
+                return -1;
+        }
+
+        cli_and_save(flags);
+        if (timer_cancel(&pcb->alarm))
+        {
+                left = ticks_to_ms(&pcb->alarm);
+        }
+        if (ms > 0)
+        {
+                pcb->alarm.expires = timer_ticks + ms_to_ticks(ms);
+                pcb->alarm.func = alarm_fire;
+                pcb->alarm.data = (uint32_t)pcb;
+                timer_add(&pcb->alarm);
+        }
+        restore_flags(flags);
+        return left;
+}
+
 
 
+
+/*  clock_gettime
+ *  INPUTS: clock_id: CLOCK_REALTIME or CLOCK_MONOTONIC
+ *          tp: user timespec to fill in
+ *  OUTPUTS: 0 on success, -1 on a bad clock id or pointer
+ *  NOTES: nanosecond resolution, from the calibrated TSC
+ */
+int32_t clock_gettime(int32_t clock_id, timespec_t* tp)
+{
+        if (tp == NULL)
+        {
+                return -1;
+        }
+
+        if ((uint32_t)tp < _128MB || (uint32_t)tp + sizeof(timespec_t) > _128MB + _4MB) // outside the program's page
+        {
+                return -1;
+        }
+
+        return clock_read(clock_id, tp);
+}
+
+/*  sysenter_init
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  NOTES: Points the SYSENTER MSRs at sysenter_entry, if the cpu has
+ *          them. KERNEL_CS works because the gdt has the kernel stack,
+ *          user code and user stack selectors right after it, in the
+ *          order sysenter and sysexit expect. The ESP MSR is a scratch
+ *          stack, sysenter_entry moves to tss.esp0 right away
+ */
+void sysenter_init(void)
+{
+        uint32_t a, b, c, d;
+
+        cpuid(CPUID_FEATURES, &a, &b, &c, &d);
+        if (!(d & CPUID_SEP))
+        {
+                return;
+        }
+
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)&sysenter_stack[SYSENTER_STACK]);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+        sysenter_enabled = 1;
+}
+
+/*  syscall_bench
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  NOTES: Prints the cycles a null syscall, getargs(NULL, 0), takes
+ *          through int 0x80 and through sysenter. The calls are made
+ *          from ring 3 by bench_user, copied to a page mapped at
+ *          BENCH_PAGE, which leaves through int BENCH_VECTOR. Uses the
+ *          boot page directory, so run it from kernel.c before any
+ *          program starts
+ */
+void syscall_bench(void)
+{
+        uint32_t frame;
+        uint32_t val;
+        uint32_t old_esp0;
+        uint32_t flags;
+        uint32_t* data;
+
+        frame = frame_alloc();
+        if (frame == 0)
+        {
+                return;
+        }
+        memset((void*)frame, 0, PAGE_SIZE);
+        memcpy((void*)frame, bench_user, bench_user_end - bench_user);
+        data = (uint32_t*)(frame + BENCH_DATA);
+        data[BENCH_SYSENTER] = sysenter_enabled;
+
+        val = frame;
+        val = val & ADDR_MASK;
+        val = val | PRESENT_BIT;
+        val = val | RW_BIT;
+        val = val | USER_BIT;
+        kernel_remap(vid_table, BENCH_INDEX, val, BENCH_PAGE);
+
+        idt[BENCH_VECTOR].present = 1;
+        idt[BENCH_VECTOR].dpl = USERPRV;
+        idt[BENCH_VECTOR].reserved0 = 0;
+        idt[BENCH_VECTOR].size = 1;
+        idt[BENCH_VECTOR].reserved1 = 1;
+        idt[BENCH_VECTOR].reserved2 = 1;
+        idt[BENCH_VECTOR].reserved3 = 0;
+        idt[BENCH_VECTOR].seg_selector = KERNEL_CS;
+        SET_IDT_ENTRY(idt[BENCH_VECTOR], (uint32_t)&bench_exit);
+
+        cli_and_save(flags);
+        old_esp0 = tss.esp0;
+        bench_run(BENCH_PAGE, BENCH_PAGE + BENCH_DATA);
+        tss.esp0 = old_esp0;
+        restore_flags(flags);
+
+        idt[BENCH_VECTOR].present = 0;
+        kernel_remap(vid_table, BENCH_INDEX, 0, BENCH_PAGE);
+
+        printf("int 0x80: %d cycles/call\n", div64_32(*(uint64_t*)&data[0], BENCH_ITERS, NULL));
+        if (sysenter_enabled)
+        {
+                printf("sysenter: %d cycles/call\n", div64_32(*(uint64_t*)&data[2], BENCH_ITERS, NULL));
+        }
+        frame_free(frame);
+}
+
+/*  stat_record
+ *  INPUTS: stat: counters to update
+ *          ret: what the syscall returned
+ *          cycles: how long it took
+ *  OUTPUTS: none
+ *  NOTES: the call itself is counted on entry, in case it never returns
+ */
+static void stat_record(syscall_stat_t* stat, int32_t ret, uint64_t cycles)
+{
+        uint32_t bucket = STAT_BUCKETS - 1;
+
+        if ((uint32_t)(cycles >> 32) == 0)
+        {
+                bucket = ((uint32_t)cycles == 0) ? 0 : 31 - __builtin_clz((uint32_t)cycles);
+        }
+        if (ret < 0)
+        {
+                stat->errors++;
+        }
+        stat->cycles += cycles;
+        stat->hist[bucket]++;
+}
+
+/*  syscall_stats_call
+ *  INPUTS: index: sys_call_table entry
+ *          arg1, arg2, arg3: the syscall's arguments
+ *  OUTPUTS: whatever the syscall returns
+ *  NOTES: DISPATCH calls this instead of the syscall while stats are on.
+ *          Counts go to the global table and the caller's own, which
+ *          is allocated the first time. execute's cycles include the
+ *          child's whole run
+ */
+int32_t syscall_stats_call(uint32_t index, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+        pcb_t* pcb = pcb_loc[sched_terminal];
+        uint64_t start;
+        int32_t ret;
+
+        if (pcb->stats == NULL)
+        {
+                pcb->stats = kmalloc(sizeof(syscall_stat_t) * SYSCALL_COUNT);
+                if (pcb->stats != NULL)
+                {
+                        memset(pcb->stats, 0, sizeof(syscall_stat_t) * SYSCALL_COUNT);
+                }
+        }
+        syscall_stats[index].calls++;
+        if (pcb->stats != NULL)
+        {
+                pcb->stats[index].calls++;
+        }
+
+        start = rdtsc();
+        ret = sys_call_table[index](arg1, arg2, arg3);
+        start = rdtsc() - start;
+
+        stat_record(&syscall_stats[index], ret, start);
+        if (pcb->stats != NULL)
+        {
+                stat_record(&pcb->stats[index], ret, start);
+        }
+        return ret;
+}
+
+/*  sysstats
+ *  INPUTS: cmd: one of the SYSSTATS_ commands
+ *          buf: user buffer for SYSSTATS_GLOBAL and SYSSTATS_PROCESS
+ *          nbytes: its size
+ *  OUTPUTS: bytes copied for the reads, 0 for the rest, -1 on a bad
+ *          command or buffer
+ *  NOTES: the tables are SYSCALL_COUNT syscall_stat_t, indexed by
+ *          syscall number - 1. A process with no calls recorded reads
+ *          zeros
+ */
+int32_t sysstats(int32_t cmd, void* buf, int32_t nbytes)
+{
+        pcb_t* pcb = pcb_loc[sched_terminal];
+        int32_t size = sizeof(syscall_stat_t) * SYSCALL_COUNT;
+
+        switch (cmd)
+        {
+                case SYSSTATS_OFF:
+                        syscall_stats_on = 0;
+                        return 0;
+                case SYSSTATS_ON:
+                        syscall_stats_on = 1;
+                        return 0;
+                case SYSSTATS_RESET:
+                        memset(syscall_stats, 0, sizeof(syscall_stats));
+                        return 0;
+                case SYSSTATS_GLOBAL:
+                case SYSSTATS_PROCESS:
+                        break;
+                default:
+                        return -1;
+        }
+
+        if (buf == NULL || nbytes < 0)
+        {
+                return -1;
+        }
+        if (nbytes > size)
+        {
+                nbytes = size;
+        }
+        if ((uint32_t)buf < _128MB || (uint32_t)buf + nbytes > _128MB + _4MB) // outside the program's page
+        {
+                return -1;
+        }
+
+        if (cmd == SYSSTATS_GLOBAL)
+        {
+                memcpy(buf, syscall_stats, nbytes);
+        }
+        else if (pcb->stats != NULL)
+        {
+                memcpy(buf, pcb->stats, nbytes);
+        }
+        else
+        {
+                memset(buf, 0, nbytes);
+        }
+        return nbytes;
+}
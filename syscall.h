@@ -9,6 +9,9 @@
 #include "paging.h"
 #include "keyboard.h"
 #include "rtc.h"
+#include "serial.h"
+#include "elf.h"
+#include "clock.h"
 
 /* Macros for syscalls */
 #define SYS_HALT    1
@@ -21,25 +24,57 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SLEEP   11
+#define SYS_ALARM   12
+#define SYS_CLOCK_GETTIME 13
+#define SYS_SYSSTATS 14
+#define SYSCALL_COUNT 14 				// entries in sys_call_table
+
+/* sysstats commands */
+#define SYSSTATS_OFF     0 				// stop recording
+#define SYSSTATS_ON      1 				// start recording
+#define SYSSTATS_RESET   2 				// zero the global counters
+#define SYSSTATS_GLOBAL  3 				// copy out every process's calls since boot
+#define SYSSTATS_PROCESS 4 				// copy out the caller's own calls
+#define STAT_BUCKETS     32 			// log2 cycle histogram, bucket i holds [2^i, 2^(i+1))
+
+/* Counters for one syscall, SYSCALL_COUNT of them per table */
+typedef struct syscall_stat {
+	uint32_t calls;
+	uint32_t errors; 					// calls that returned a negative value
+	uint64_t cycles; 					// total, calls that never return (halt) add nothing
+	uint32_t hist[STAT_BUCKETS];
+} syscall_stat_t;
+
+/* SYSENTER fast syscalls */
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define CPUID_SEP        0x00000800 	// edx bit 11, sysenter/sysexit supported
+#define SYSENTER_STACK   64 			// scratch stack sysenter lands on
+
+/* Null syscall benchmark, must match wrapper.S */
+#define BENCH_VECTOR     0x81 			// int the benchmark leaves ring 3 with
+#define BENCH_PAGE       (MB136 + 2 * _4KB)
+#define BENCH_INDEX      2 				// its entry in the video table
+#define BENCH_DATA       0xF00 			// results, the user stack is below
+#define BENCH_SYSENTER   4 				// word telling the user code to try sysenter
+#define BENCH_ITERS      10000
 #define SYSCALLS 0x80
-#define MAX_PROCESSES 6
 #define PROGADDR 	0x08048000
 #define _128MB		0x08000000
 
-#define ELF_SIZE 4
-//elf magic 
-#define MAGIC0 0x7F
-#define MAGIC1 0x45
-#define MAGIC2 0x4C
-#define MAGIC3 0x46
+/* How execute puts the program image at PROGADDR */
+#define LOAD_COPY	0			// copy every PT_LOAD segment up front
+#define LOAD_DEMAND	1			// fault pages in on first touch, copy on write
+#define EXEC_LOAD_MODE LOAD_DEMAND
 
-#define BUFFASIZE 128
-#define BIT_A 24
-#define BIT_B 25
-#define BIT_C 26
-#define BIT_D 27
+#define EXCEPTION_STATUS 256	// returned to the parent when a program is killed
+
+/* Frames a program needs to start: page tables, PCB, a code page and a stack page */
+#define EXEC_MIN_FRAMES (PROG_FRAMES + KSTACK_FRAMES + 2)
 
-#define SHIFT 8
+#define BUFFASIZE 128
 
 #define STACKBOT 0x08400000
 
@@ -54,6 +89,7 @@
 #define NUM_TERM 3
 
 int32_t halt(uint8_t status);
+int32_t halt_status(uint32_t status);
 int32_t execute(const uint8_t* command);
 int32_t read(int32_t fd, void* buf, int32_t nbytes);
 int32_t write(int32_t fd, const void* buf, int32_t nbytes);
@@ -63,19 +99,35 @@ int32_t getargs(uint8_t* buf, int32_t nbytes);
 int32_t vidmap(uint8_t** screen_start);
 int32_t set_handler(int32_t signum, void* handler);
 int32_t sigreturn(void);
+int32_t sleep(int32_t ms);
+int32_t alarm(int32_t ms);
+int32_t clock_gettime(int32_t clock_id, timespec_t* tp);
+int32_t sysstats(int32_t cmd, void* buf, int32_t nbytes);
 
 /* Helper Functions */
+int32_t can_execute(void);
+void sysenter_init(void);
+void syscall_bench(void);
 //int32_t terminal_init();
 
 //EXTERNED SHELL 
 extern int32_t shell_count;
 
 extern void sys_call_handler();
+extern int32_t (*sys_call_table[SYSCALL_COUNT])();
+extern int32_t syscall_stats_on;
+int32_t syscall_stats_call(uint32_t index, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+extern void sysenter_entry();
+extern void bench_run(uint32_t eip, uint32_t esp);
+extern void bench_exit();
+extern uint8_t bench_user[];
+extern uint8_t bench_user_end[];
 extern int32_t (*fs_jmp_table[4])();
 extern int32_t (*stdin_jmp_table[4])();
 extern int32_t (*stdout_jmp_table[4])();
 extern int32_t (*dir_jmp_table[4])();
 extern int32_t (*rtc_jmp_table[4])(); 
+extern int32_t (*serial_jmp_table[4])();
 
 extern int32_t prog_count[NUM_TERM];
 #endif
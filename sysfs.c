@@ -0,0 +1,373 @@
+/**
+***	sysfs.c: Synthetic files showing live kernel statistics.
+**/
+
+#include "sysfs.h"
+#include "lib.h"
+#include "syscall.h"
+#include "sched.h"
+#include "frame.h"
+#include "slab.h"
+#include "i8259.h"
+#include "timer.h"
+#include "clock.h"
+#include "prof.h"
+#include "trace.h"
+#include "serial.h"
+#include "klog.h"
+
+/* Name of each IRQ line worth listing in sys/irqs */
+typedef struct irq_name {
+	uint32_t irq;
+	const int8_t* name;
+} irq_name_t;
+
+static const irq_name_t irq_names[] = {
+	{PIT, "pit"}, {KEYBOARD, "keyboard"}, {SERIAL, "serial"}, {RTC, "rtc"}
+};
+
+/* Text of the file being read, built again on every read. Reads run
+ * with interrupts off and never sleep, so one buffer is enough. */
+static int8_t sysfs_buf[SYSFS_BUF_SIZE];
+static uint32_t sysfs_len;
+
+/* 
+ * emit
+ * Appends a string to the text being built
+ * INPUTS: s - NUL terminated string
+ *		   n - most characters to take from it
+ * OUTPUTS: none
+ * EFFECTS: Text past SYSFS_BUF_SIZE is dropped.
+ */
+static void emit(const int8_t* s, uint32_t n)
+{
+	while (*s != '\0' && n-- > 0 && sysfs_len < SYSFS_BUF_SIZE)
+	{
+		sysfs_buf[sysfs_len++] = *s++;
+	}
+}
+
+/* 
+ * emit_num
+ * Appends a number in decimal followed by a separator
+ * INPUTS: n - number
+ *		   sep - character after it, a space or newline
+ * OUTPUTS: none
+ * EFFECTS: none
+ */
+static void emit_num(uint32_t n, int8_t sep)
+{
+	int8_t num[12];
+	int8_t end[2] = {sep, '\0'};
+
+	emit(itoa(n, num, 10), sizeof(num));
+	emit(end, 1);
+}
+
+/* 
+ * emit_field
+ * Appends a "name value" line
+ * INPUTS: name - field name
+ *		   n - value
+ * OUTPUTS: none
+ * EFFECTS: none
+ */
+static void emit_field(const int8_t* name, uint32_t n)
+{
+	emit(name, SYSFS_BUF_SIZE);
+	emit(" ", 1);
+	emit_num(n, '\n');
+}
+
+/* 
+ * procs_show
+ * Builds sys/procs
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: One line per running program: pid, terminal, parent pid and
+ *			arguments, each terminal's programs from newest to oldest.
+ */
+static void procs_show(void)
+{
+	pcb_t* pcb;
+	int32_t terminal, i;
+
+	emit("PID TERM PARENT ARGS\n", SYSFS_BUF_SIZE);
+	for (terminal = 0; terminal < NUMTERMINALS; terminal++)
+	{
+		pcb = pcb_loc[terminal];
+		for (i = 0; i < prog_count[terminal] && pcb != NULL; i++)
+		{
+			emit_num(pcb->pid, ' ');
+			emit_num(terminal + 1, ' ');
+			emit_num(pcb->lastpcb_ptr->pid, ' ');
+			emit((int8_t*)pcb->args, ARG_SIZE);
+			emit("\n", 1);
+			pcb = pcb->lastpcb_ptr;
+		}
+	}
+}
+
+/* 
+ * irqs_show
+ * Builds sys/irqs
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: One "IRQ COUNT NAME" line per device interrupt since boot.
+ */
+static void irqs_show(void)
+{
+	uint32_t i;
+
+	emit("IRQ COUNT NAME\n", SYSFS_BUF_SIZE);
+	for (i = 0; i < sizeof(irq_names) / sizeof(irq_names[0]); i++)
+	{
+		emit_num(irq_names[i].irq, ' ');
+		emit_num(irq_count[irq_names[i].irq], ' ');
+		emit(irq_names[i].name, SYSFS_BUF_SIZE);
+		emit("\n", 1);
+	}
+}
+
+/* 
+ * mem_show
+ * Builds sys/mem
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Free frames, then one line per slab cache: name, object
+ *			size, objects in use, objects allocated, slabs and failed
+ *			allocations.
+ */
+static void mem_show(void)
+{
+	slab_cache_t* cache;
+	uint32_t i;
+
+	emit_field("frames_free", frame_free_count());
+	emit_field("kb_free", frame_free_count() * (FRAME_SIZE >> KB_SHIFT));
+	emit("CACHE SIZE USED TOTAL SLABS FAILS\n", SYSFS_BUF_SIZE);
+	for (i = 0; (cache = slab_cache_at(i)) != NULL; i++)
+	{
+		emit(cache->name, SYSFS_BUF_SIZE);
+		emit(" ", 1);
+		emit_num(cache->obj_size, ' ');
+		emit_num(cache->in_use, ' ');
+		emit_num(cache->total, ' ');
+		emit_num(cache->slabs, ' ');
+		emit_num(cache->fails, '\n');
+	}
+}
+
+/* 
+ * sched_show
+ * Builds sys/sched
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Clock rates, uptime, the terminal running and context
+ *			switch latency in cycles.
+ */
+static void sched_show(void)
+{
+	switch_stats_t stats;
+
+	sched_get_stats(&stats);
+	emit_field("uptime_ms", timer_ticks * MS_PER_TICK);
+	emit_field("timer_hz", TIMER_HZ);
+	emit_field("sched_hz", SCHED_HZ);
+	emit_field("tsc_khz", clock_tsc_khz());
+	emit_field("terminal", sched_terminal + 1);
+	emit_field("switches", stats.count);
+	emit_field("switch_last", stats.last);
+	emit_field("switch_min", stats.count ? stats.min : 0);
+	emit_field("switch_avg", stats.avg);
+	emit_field("switch_max", stats.max);
+}
+
+/* 
+ * trace_show
+ * Builds sys/trace
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Whether tracing is on and how many events it has recorded
+ *			and holds for the next drain.
+ */
+static void trace_show(void)
+{
+	trace_stats_t stats;
+
+	trace_get_stats(&stats);
+	emit_field("on", stats.on);
+	emit_field("recorded", stats.recorded);
+	emit_field("pending", stats.pending);
+	emit_field("ring_size", TRACE_EVENTS);
+}
+
+/* 
+ * sysfs_read
+ * Reads part of a stats file
+ * INPUTS: fd - open stats file
+ *		   buf - where the text goes
+ *		   nbytes - most bytes to read
+ *		   show - builds the file's text
+ * OUTPUTS: bytes read, 0 at the end, -1 on a bad buffer
+ * EFFECTS: The text is built only now, so it is current, and file_pos
+ *			moves past what was read.
+ */
+static int32_t sysfs_read(int32_t fd, void* buf, int32_t nbytes, void (*show)(void))
+{
+	fd_entry_t* entry = &pcb_loc[sched_terminal]->file_desc[fd];
+
+	if (buf == NULL || nbytes < 0)
+	{
+		return -1;
+	}
+
+	sysfs_len = 0;
+	show();
+	if (entry->file_pos >= sysfs_len)
+	{
+		return 0;
+	}
+	if ((uint32_t)nbytes > sysfs_len - entry->file_pos)
+	{
+		nbytes = sysfs_len - entry->file_pos;
+	}
+	memcpy(buf, sysfs_buf + entry->file_pos, nbytes);
+	entry->file_pos += nbytes;
+	return nbytes;
+}
+
+/* 
+ * sysfs_open, sysfs_write, sysfs_close
+ * The rest of every stats file's jump table
+ * INPUTS: ignored
+ * OUTPUTS: 0 for open and close, -1 for write
+ * EFFECTS: Stats files are read-only.
+ */
+static int32_t sysfs_open(const uint8_t* filename)
+{
+	return 0;
+}
+
+static int32_t sysfs_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	return -1;
+}
+
+static int32_t sysfs_close(int32_t fd)
+{
+	return 0;
+}
+
+/* One read per file, each just names its text builder */
+static int32_t procs_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return sysfs_read(fd, buf, nbytes, procs_show);
+}
+
+static int32_t irqs_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return sysfs_read(fd, buf, nbytes, irqs_show);
+}
+
+static int32_t mem_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return sysfs_read(fd, buf, nbytes, mem_show);
+}
+
+static int32_t sched_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return sysfs_read(fd, buf, nbytes, sched_show);
+}
+
+static int32_t trace_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	return sysfs_read(fd, buf, nbytes, trace_show);
+}
+
+/* Jump tables, in the CALL_OPEN/READ/WRITE/CLOSE order */
+static int32_t (*procs_fops[JMPTABLE_SIZE])() = {&sysfs_open, &procs_read, &sysfs_write, &sysfs_close};
+static int32_t (*irqs_fops[JMPTABLE_SIZE])() = {&sysfs_open, &irqs_read, &sysfs_write, &sysfs_close};
+static int32_t (*mem_fops[JMPTABLE_SIZE])() = {&sysfs_open, &mem_read, &sysfs_write, &sysfs_close};
+static int32_t (*sched_fops[JMPTABLE_SIZE])() = {&sysfs_open, &sched_read, &sysfs_write, &sysfs_close};
+static int32_t (*prof_fops[JMPTABLE_SIZE])() = {&sysfs_open, &prof_read, &prof_write, &sysfs_close};
+static int32_t (*trace_fops[JMPTABLE_SIZE])() = {&sysfs_open, &trace_read, &trace_write, &sysfs_close};
+static int32_t (*dmesg_fops[JMPTABLE_SIZE])() = {&sysfs_open, &klog_read, &klog_write, &sysfs_close};
+
+/* Every stats file, a dentry's inode is its index here */
+typedef struct sysfs_entry {
+	const int8_t* name;
+	func_t* fops;
+} sysfs_entry_t;
+
+static const sysfs_entry_t sysfs_entries[] = {
+	{"sys/procs", procs_fops},
+	{"sys/irqs", irqs_fops},
+	{"sys/mem", mem_fops},
+	{"sys/sched", sched_fops},
+	{"sys/prof", prof_fops},
+	{"sys/trace", trace_fops},
+	{"sys/dmesg", dmesg_fops}
+};
+
+#define SYSFS_ENTRIES (sizeof(sysfs_entries) / sizeof(sysfs_entries[0]))
+
+/* 
+ * sysfs_dentry
+ * Builds the dentry of a stats file
+ * INPUTS: index - which stats file
+ *		   dentry - dentry to fill in
+ * OUTPUTS: 0 on success, -1 past the last file
+ * EFFECTS: none
+ */
+int32_t sysfs_dentry(uint32_t index, dentry_t* dentry)
+{
+	if (index >= SYSFS_ENTRIES)
+	{
+		return -1;
+	}
+
+	memset(dentry, 0, sizeof(dentry_t));
+	strncpy((int8_t*)dentry->name, sysfs_entries[index].name, NAME_SIZE);
+	dentry->type = SYSFS_TYPE;
+	dentry->inode = index;
+	return 0;
+}
+
+/* 
+ * sysfs_lookup
+ * Finds a stats file by name
+ * INPUTS: fname - name to look for
+ *		   dentry - dentry to fill in
+ * OUTPUTS: 0 if found, -1 otherwise
+ * EFFECTS: A linear scan, there are only a handful of files.
+ */
+int32_t sysfs_lookup(const uint8_t* fname, dentry_t* dentry)
+{
+	uint32_t i;
+
+	for (i = 0; i < SYSFS_ENTRIES; i++)
+	{
+		if (strncmp(sysfs_entries[i].name, (const int8_t*)fname, NAME_SIZE) == 0)
+		{
+			return sysfs_dentry(i, dentry);
+		}
+	}
+	return -1;
+}
+
+/* 
+ * sysfs_fops
+ * Looks up a stats file's jump table
+ * INPUTS: inode - inode of a SYSFS_TYPE dentry
+ * OUTPUTS: its jump table, NULL for a bad inode
+ * EFFECTS: none
+ */
+func_t* sysfs_fops(uint32_t inode)
+{
+	if (inode >= SYSFS_ENTRIES)
+	{
+		return NULL;
+	}
+	return sysfs_entries[inode].fops;
+}
@@ -0,0 +1,20 @@
+#ifndef _SYSFS_H
+#define _SYSFS_H
+
+#include "types.h"
+#include "filesys.h"
+#include "pcb.h"
+
+#define SYSFS_TYPE		3			// dentry type of the synthetic stats files
+#define SYSFS_BUF_SIZE	4096		// longest text a stats file can show
+
+/* Finds a stats file by name, same contract as read_dentry_by_name */
+int32_t sysfs_lookup(const uint8_t* fname, dentry_t* dentry);
+
+/* The index'th stats file, for listing after the boot image's entries */
+int32_t sysfs_dentry(uint32_t index, dentry_t* dentry);
+
+/* Jump table of the stats file behind a SYSFS_TYPE dentry's inode */
+func_t* sysfs_fops(uint32_t inode);
+
+#endif
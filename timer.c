@@ -0,0 +1,265 @@
+/**
+***	timer.c: Hierarchical timing wheel driven by the PIT.
+**/
+
+#include "timer.h"
+#include "lib.h"
+
+volatile uint32_t timer_ticks = 0;
+
+/* Next tick the wheel will process, timer_ticks + 1 between interrupts */
+static uint32_t wheel_ticks = 0;
+
+/* Slot list heads, circular with the head as sentinel */
+static timer_link_t tv1[TVR_SIZE];
+static timer_link_t tvn[TVN_COUNT][TVN_SIZE];
+
+/* Slot of wheel n (0 is the first 64 slot wheel) that wheel_ticks is in */
+#define TVN_INDEX(n)	((wheel_ticks >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+/* 
+ * list_init
+ * Makes an empty slot list
+ * INPUTS: head - slot list head
+ * OUTPUTS: none
+ * EFFECTS: head points at itself
+ */
+static void list_init(timer_link_t* head)
+{
+	head->next = head;
+	head->prev = head;
+}
+
+/* 
+ * list_add
+ * Appends a timer to a slot list
+ * INPUTS: head - slot list head
+ *		   link - link of a timer that is on no list
+ * OUTPUTS: none
+ * EFFECTS: link sits just before the head
+ */
+static void list_add(timer_link_t* head, timer_link_t* link)
+{
+	link->next = head;
+	link->prev = head->prev;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+/* 
+ * wheel_insert
+ * Puts a timer in the slot for its expiry
+ * INPUTS: timer - timer that is on no list
+ * OUTPUTS: none
+ * EFFECTS: Timers within 256 ticks go in the first wheel at their exact
+ *			tick, later ones in the coarsest wheel that can hold them.
+ *			Those cascade down as the wheel turns. Call with interrupts off.
+ */
+static void wheel_insert(timer_t* timer)
+{
+	uint32_t expires = timer->expires;
+	uint32_t delta = expires - wheel_ticks;
+	timer_link_t* head;
+	int32_t n;
+
+	if ((int32_t)delta < 0)
+	{
+		/* already due, fire on the next tick */
+		head = &tv1[wheel_ticks & TVR_MASK];
+	}
+	else if (delta < TVR_SIZE)
+	{
+		head = &tv1[expires & TVR_MASK];
+	}
+	else
+	{
+		for (n = 0; n < TVN_COUNT - 1; n++)
+		{
+			if (delta < (1U << (TVR_BITS + (n + 1) * TVN_BITS)))
+			{
+				break;
+			}
+		}
+		head = &tvn[n][(expires >> (TVR_BITS + n * TVN_BITS)) & TVN_MASK];
+	}
+	list_add(head, &timer->link);
+}
+
+/* 
+ * cascade
+ * Moves the timers in one slot of a coarse wheel down a level
+ * INPUTS: n - coarse wheel
+ *		   index - slot in it
+ * OUTPUTS: index, so 0 means the next wheel up has to cascade too
+ * EFFECTS: Every timer in the slot is reinserted relative to wheel_ticks.
+ */
+static uint32_t cascade(int32_t n, uint32_t index)
+{
+	timer_link_t* head = &tvn[n][index];
+	timer_link_t* link = head->next;
+	timer_link_t* next;
+
+	list_init(head);
+	while (link != head)
+	{
+		next = link->next;
+		wheel_insert((timer_t*)link);
+		link = next;
+	}
+	return index;
+}
+
+/* 
+ * timer_init
+ * Empties the wheel
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Every slot list is empty and time starts at 0.
+ */
+void timer_init(void)
+{
+	int32_t i, n;
+
+	for (i = 0; i < TVR_SIZE; i++)
+	{
+		list_init(&tv1[i]);
+	}
+	for (n = 0; n < TVN_COUNT; n++)
+	{
+		for (i = 0; i < TVN_SIZE; i++)
+		{
+			list_init(&tvn[n][i]);
+		}
+	}
+	timer_ticks = 0;
+	wheel_ticks = 0;
+}
+
+/* 
+ * timer_add
+ * Arms a timer
+ * INPUTS: timer - timer with expires, func and data filled in, not pending
+ * OUTPUTS: none
+ * EFFECTS: O(1), the timer goes straight into its slot.
+ */
+void timer_add(timer_t* timer)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	wheel_insert(timer);
+	restore_flags(flags);
+}
+
+/* 
+ * timer_cancel
+ * Disarms a timer
+ * INPUTS: timer - timer to disarm, pending or not
+ * OUTPUTS: 1 if it was pending, 0 if it had fired or was never armed
+ * EFFECTS: O(1), the timer unlinks itself from whatever slot it is in.
+ */
+int32_t timer_cancel(timer_t* timer)
+{
+	uint32_t flags;
+	int32_t pending = 0;
+
+	cli_and_save(flags);
+	if (timer->link.next != NULL)
+	{
+		timer->link.prev->next = timer->link.next;
+		timer->link.next->prev = timer->link.prev;
+		timer->link.next = NULL;
+		timer->link.prev = NULL;
+		pending = 1;
+	}
+	restore_flags(flags);
+	return pending;
+}
+
+/* 
+ * timer_pending
+ * Checks whether a timer is armed
+ * INPUTS: timer - timer to check
+ * OUTPUTS: 1 if it is waiting to fire, 0 otherwise
+ * EFFECTS: none
+ */
+int32_t timer_pending(timer_t* timer)
+{
+	return timer->link.next != NULL;
+}
+
+/* 
+ * timer_tick
+ * Advances time by one tick
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Called by the PIT. Keeps interrupts off itself while the
+ *			wheel turns, so a nested tick or a task switch can't land in
+ *			the middle of a cascade or of the expired list. Every 256
+ *			ticks the next slot of the coarse wheels cascades down, then
+ *			the current slot of the first wheel fires. A timer is
+ *			unlinked before its function runs, so the function may add
+ *			it again.
+ */
+void timer_tick(void)
+{
+	timer_link_t expired;
+	timer_link_t* link;
+	timer_t* timer;
+	uint32_t index;
+	uint32_t flags;
+	int32_t n;
+
+	cli_and_save(flags);
+	timer_ticks++;
+	while ((int32_t)(timer_ticks - wheel_ticks) >= 0)
+	{
+		index = wheel_ticks & TVR_MASK;
+		if (index == 0)
+		{
+			for (n = 0; n < TVN_COUNT; n++)
+			{
+				if (cascade(n, TVN_INDEX(n)) != 0)
+				{
+					break;
+				}
+			}
+		}
+		wheel_ticks++;
+
+		/* take the whole slot first, functions may add to it */
+		if (tv1[index].next == &tv1[index])
+		{
+			continue;
+		}
+		expired.next = tv1[index].next;
+		expired.prev = tv1[index].prev;
+		expired.next->prev = &expired;
+		expired.prev->next = &expired;
+		list_init(&tv1[index]);
+
+		while (expired.next != &expired)
+		{
+			link = expired.next;
+			timer = (timer_t*)link;
+			expired.next = link->next;
+			link->next->prev = &expired;
+			link->next = NULL;
+			link->prev = NULL;
+			timer->func(timer->data);
+		}
+	}
+	restore_flags(flags);
+}
+
+/* 
+ * ms_to_ticks
+ * Converts a duration to ticks
+ * INPUTS: ms - milliseconds
+ * OUTPUTS: ticks covering at least ms
+ * EFFECTS: none
+ */
+uint32_t ms_to_ticks(uint32_t ms)
+{
+	return ms / MS_PER_TICK + (ms % MS_PER_TICK != 0);
+}
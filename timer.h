@@ -0,0 +1,55 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+/* The PIT ticks TIMER_HZ times a second, a timer's resolution */
+#define TIMER_HZ		1000
+#define MS_PER_TICK		(1000 / TIMER_HZ)
+
+/* Timing wheel: one 256 slot wheel of single ticks, then four 64 slot
+ * wheels each covering 64 times the one below, 32 bits in total */
+#define TVR_BITS		8
+#define TVN_BITS		6
+#define TVR_SIZE		(1 << TVR_BITS)
+#define TVN_SIZE		(1 << TVN_BITS)
+#define TVR_MASK		(TVR_SIZE - 1)
+#define TVN_MASK		(TVN_SIZE - 1)
+#define TVN_COUNT		4
+
+/* Doubly linked so a timer unlinks itself in O(1) */
+typedef struct timer_link {
+	struct timer_link* next;		// NULL while the timer is not pending
+	struct timer_link* prev;
+} timer_link_t;
+
+/* A one shot timer, func(data) runs in the PIT interrupt at expires */
+typedef struct timer {
+	timer_link_t link;				// must stay first
+	uint32_t expires;				// timer_ticks value to fire at
+	void (*func)(uint32_t data);
+	uint32_t data;
+} timer_t;
+
+/* Ticks since timer_init, wraps after ~49 days */
+extern volatile uint32_t timer_ticks;
+
+/* Empties the wheel */
+void timer_init(void);
+
+/* Arms a timer that is not pending, an expiry in the past fires next tick */
+void timer_add(timer_t* timer);
+
+/* Disarms a timer, returns 1 if it was pending */
+int32_t timer_cancel(timer_t* timer);
+
+/* 1 while the timer is armed and has not fired */
+int32_t timer_pending(timer_t* timer);
+
+/* Called on every PIT tick, advances time and fires expired timers */
+void timer_tick(void);
+
+/* Whole ticks covering ms milliseconds, rounded up */
+uint32_t ms_to_ticks(uint32_t ms);
+
+#endif
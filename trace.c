@@ -0,0 +1,229 @@
+/**
+***	trace.c: Static tracepoints recorded into a lock-free event ring and
+***			 drained over the serial port.
+**/
+
+#include "trace.h"
+#include "lib.h"
+#include "pcb.h"
+#include "keyboard.h"
+#include "clock.h"
+#include "serial.h"
+#include "sched.h"
+
+/* One ring per cpu, this kernel runs on one. A writer reserves its slot
+ * by bumping trace_head with a single xadd, which an interrupt can't
+ * split, so a handler that interrupts a writer just takes the next slot.
+ * trace_seq[slot] is set last, to the event's position plus one, so a
+ * reader can tell a finished event from one half written or lapped. */
+static trace_event_t trace_ring[TRACE_EVENTS];
+static volatile uint32_t trace_seq[TRACE_EVENTS];
+static volatile uint32_t trace_head = 0;		// position of the next event
+static uint32_t trace_tail = 0;					// position the next drain starts at
+static volatile uint32_t trace_on = 1;				// start and stop set this
+static volatile uint32_t trace_paused = 0;			// set by traced while it sends a dump
+static uint32_t trace_drains = 0;					// drains asked for and not started yet
+static wait_queue_t trace_queue = WAIT_QUEUE_INIT;
+
+/*
+ * trace_event
+ * Records an event in the ring
+ * INPUTS: type - one of the TR_ types
+ *		   arg - type specific payload
+ * OUTPUTS: none
+ * EFFECTS: Takes no lock and leaves interrupts alone, so it can be
+ *			called from anywhere, handlers included. The pid is the
+ *			program running on the scheduled terminal.
+ */
+void trace_event(uint32_t type, uint32_t arg)
+{
+	trace_event_t* event;
+	uint32_t pos = 1;
+
+	if (!trace_on || trace_paused)
+	{
+		return;
+	}
+
+	asm volatile("xaddl %0, %1"
+			: "+r"(pos), "+m"(trace_head)
+			:
+			: "memory", "cc");
+
+	trace_seq[pos & TRACE_MASK] = 0;
+	barrier();
+	event = &trace_ring[pos & TRACE_MASK];
+	event->tsc = rdtsc();
+	event->type = type;
+	event->pid = prog_count[sched_terminal] != 0 ? pcb_loc[sched_terminal]->pid : TRACE_NO_PID;
+	event->arg = arg;
+	barrier();
+	trace_seq[pos & TRACE_MASK] = pos + 1;
+}
+
+/*
+ * traced_main
+ * Body of the traced task
+ * INPUTS: unused - task argument
+ * OUTPUTS: never returns
+ * EFFECTS: Sleeps until a drain is asked for, then sends a
+ *			trace_header_t and the events recorded since the last drain,
+ *			oldest first. Events lost to the ring wrapping are counted in
+ *			the header, slots caught mid write go out as TR_NONE.
+ *			Recording pauses while the events go out, without touching
+ *			start and stop. A full ring takes seconds at 115200 baud, so
+ *			this runs with interrupts on and sleeps whenever the serial
+ *			queue is full.
+ */
+static void traced_main(int32_t unused)
+{
+	trace_header_t header;
+	trace_event_t event;
+	uint32_t head, tail, pos, slot;
+
+	while (1)
+	{
+		cli();
+		while (trace_drains == 0)
+		{
+			sleep_on(&trace_queue);
+		}
+		trace_drains = 0;
+		trace_paused = 1;
+		head = trace_head;
+
+		header.magic = TRACE_MAGIC;
+		header.dropped = 0;
+		if (head - trace_tail > TRACE_EVENTS)
+		{
+			header.dropped = head - trace_tail - TRACE_EVENTS;
+			trace_tail = head - TRACE_EVENTS;
+		}
+		tail = trace_tail;
+		header.count = head - tail;
+		header.tsc_khz = clock_tsc_khz();
+		sti();
+
+		serial_send(&header, sizeof(header));
+		for (pos = tail; pos != head; pos++)
+		{
+			slot = pos & TRACE_MASK;
+			event = trace_ring[slot];
+			if (trace_seq[slot] != pos + 1)
+			{
+				event.type = TR_NONE;
+			}
+			serial_send(&event, sizeof(event));
+		}
+
+		cli();
+		if ((int32_t)(head - trace_tail) > 0)			// a reset meanwhile already moved it
+		{
+			trace_tail = head;
+		}
+		trace_paused = 0;
+		sti();
+	}
+}
+
+/*
+ * trace_init
+ * Starts traced
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Must come after sched_init.
+ */
+void trace_init(void)
+{
+	if (sched_add_kthread(traced_main) != 0)
+	{
+		printk("traced not started, out of memory\n");
+	}
+}
+
+/*
+ * trace_drain
+ * Asks traced to dump the events recorded since the last drain
+ * INPUTS: none
+ * OUTPUTS: none
+ * EFFECTS: Returns at once, safe with interrupts off. Drains asked for
+ *			while one is running are done together once it finishes.
+ */
+void trace_drain(void)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	trace_drains++;
+	restore_flags(flags);
+	wake_one(&trace_queue);
+}
+
+/*
+ * trace_get_stats
+ * Reads tracing's state
+ * INPUTS: stats - where it goes
+ * OUTPUTS: none
+ * EFFECTS: none
+ */
+void trace_get_stats(trace_stats_t* stats)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	stats->on = trace_on;
+	stats->recorded = trace_head;
+	stats->pending = trace_head - trace_tail;
+	if (stats->pending > TRACE_EVENTS)
+	{
+		stats->pending = TRACE_EVENTS;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * trace_write
+ * Controls tracing
+ * INPUTS: fd - open sys/trace
+ *		   buf - "start", "stop", "reset" or "drain", a trailing newline is fine
+ *		   nbytes - its length
+ * OUTPUTS: nbytes on success, -1 on an unknown command
+ * EFFECTS: reset throws away the events not drained yet. drain only
+ *			queues the dump for traced and returns.
+ */
+int32_t trace_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	const int8_t* cmd = buf;
+	uint32_t flags;
+
+	if (buf == NULL)
+	{
+		return -1;
+	}
+
+	if (nbytes >= 5 && strncmp(cmd, "drain", 5) == 0)
+	{
+		trace_drain();
+		return nbytes;
+	}
+
+	cli_and_save(flags);
+	if (nbytes >= 5 && strncmp(cmd, "start", 5) == 0)
+	{
+		trace_on = 1;
+	}
+	else if (nbytes >= 4 && strncmp(cmd, "stop", 4) == 0)
+	{
+		trace_on = 0;
+	}
+	else if (nbytes >= 5 && strncmp(cmd, "reset", 5) == 0)
+	{
+		trace_tail = trace_head;
+	}
+	else
+	{
+		nbytes = -1;
+	}
+	restore_flags(flags);
+	return nbytes;
+}
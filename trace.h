@@ -0,0 +1,76 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/* Build with -DTRACE_ENABLE=0 to compile every tracepoint out */
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE	1
+#endif
+
+/* Event types, trace_decode.py keeps the same numbers */
+#define TR_NONE			0			// slot being written or overwritten, skipped
+#define TR_EXEC_ENTER	1			// arg: unused
+#define TR_EXEC_EXIT	2			// arg: execute's return value
+#define TR_HALT			3			// arg: status
+#define TR_TERM_SWITCH	4			// arg: terminal now displayed
+#define TR_SCHED		5			// arg: terminal of the task picked
+#define TR_IRQ_ENTER	6			// arg: irq line
+#define TR_IRQ_EXIT		7			// arg: irq line
+#define TR_PAGE_FAULT	8			// arg: faulting address
+
+#define TRACE_EVENTS	4096		// ring size, a power of two, the oldest events are overwritten
+#define TRACE_MASK		(TRACE_EVENTS - 1)
+#define TRACE_NO_PID	0xFFFF		// no program running on the terminal
+#define TRACE_MAGIC		0x45435254	// "TRCE", starts every dump on the serial port
+
+#ifndef ASM
+
+#include "types.h"
+
+/* One event as it sits in the ring and goes over the wire, 16 bytes */
+typedef struct trace_event {
+	uint64_t tsc;
+	uint16_t type;
+	uint16_t pid;
+	uint32_t arg;
+} trace_event_t;
+
+/* Dump header, followed by count events */
+typedef struct trace_header {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t tsc_khz;				// for converting timestamps
+	uint32_t dropped;				// events overwritten before this dump
+} trace_header_t;
+
+/* What sys/trace shows */
+typedef struct trace_stats {
+	uint32_t on;
+	uint32_t recorded;				// events since boot
+	uint32_t pending;				// events the next drain sends
+} trace_stats_t;
+
+#if TRACE_ENABLE
+#define TRACE(type, arg)	trace_event((type), (uint32_t)(arg))
+#else
+#define TRACE(type, arg)	do {} while (0)
+#endif
+
+/* Records an event, safe from interrupt handlers */
+void trace_event(uint32_t type, uint32_t arg);
+
+/* Starts traced, which sends the dumps. Call after sched_init. */
+void trace_init(void);
+
+/* Has traced send the events recorded since the last drain over the
+ * serial port. Returns at once. */
+void trace_drain(void);
+
+/* Fills in stats for sys/trace */
+void trace_get_stats(trace_stats_t* stats);
+
+/* sys/trace: writing start, stop, reset or drain controls tracing */
+int32_t trace_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif /* ASM */
+
+#endif
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Decodes trace dumps captured off the serial port into Chrome trace JSON.
+
+Usage: trace_decode.py capture.bin [trace.json]
+
+The capture is whatever COM1 sent, e.g. from qemu -serial file:capture.bin,
+and may hold several dumps mixed with other output. Each dump is found by
+its "TRCE" magic. The JSON goes to stdout unless a file is named, and
+loads in chrome://tracing or Perfetto. Programs show as threads by pid,
+IRQs get a thread of their own.
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = b"TRCE"
+HEADER = struct.Struct("<IIII")         # magic, count, tsc_khz, dropped
+EVENT = struct.Struct("<QHHI")          # tsc, type, pid, arg
+
+# trace.h event types
+TR_NONE, TR_EXEC_ENTER, TR_EXEC_EXIT, TR_HALT, TR_TERM_SWITCH, \
+    TR_SCHED, TR_IRQ_ENTER, TR_IRQ_EXIT, TR_PAGE_FAULT = range(9)
+NO_PID = 0xFFFF
+
+IRQ_TID = 1000
+KERNEL_TID = 1001
+IRQ_NAMES = {0: "pit", 1: "keyboard", 8: "rtc"}
+
+
+def read_dumps(data):
+    """Yields (tsc_khz, dropped, events) for every complete dump."""
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        if pos + HEADER.size > len(data):
+            return
+        _, count, khz, dropped = HEADER.unpack_from(data, pos)
+        start = pos + HEADER.size
+        end = start + count * EVENT.size
+        if end > len(data):
+            sys.stderr.write("truncated dump, %d events expected\n" % count)
+            return
+        yield khz, dropped, [EVENT.unpack_from(data, start + i * EVENT.size)
+                             for i in range(count)]
+        pos = data.find(MAGIC, end)
+
+
+def tid_of(pid):
+    return KERNEL_TID if pid == NO_PID else pid
+
+
+def convert(event, base, khz):
+    """The Chrome trace event for one kernel event, None to skip it."""
+    tsc, kind, pid, arg = event
+    out = {"pid": 0, "tid": tid_of(pid), "ts": (tsc - base) * 1000.0 / khz}
+    if kind == TR_EXEC_ENTER:
+        out.update(ph="B", name="execute")
+    elif kind == TR_EXEC_EXIT:
+        out.update(ph="E", name="execute",
+                   args={"ret": struct.unpack("<i", struct.pack("<I", arg))[0]})
+    elif kind == TR_HALT:
+        out.update(ph="i", s="t", name="halt", args={"status": arg})
+    elif kind == TR_TERM_SWITCH:
+        out.update(ph="i", s="g", name="terminal %d" % (arg + 1))
+    elif kind == TR_SCHED:
+        out.update(ph="i", s="t", name="sched",
+                   args={"next": "idle" if arg == 0xFFFFFFFF else arg + 1})
+    elif kind in (TR_IRQ_ENTER, TR_IRQ_EXIT):
+        out.update(ph="B" if kind == TR_IRQ_ENTER else "E", tid=IRQ_TID,
+                   name=IRQ_NAMES.get(arg, "irq %d" % arg), args={"pid": pid})
+    elif kind == TR_PAGE_FAULT:
+        out.update(ph="i", s="t", name="page fault",
+                   args={"addr": "0x%08x" % arg})
+    else:
+        return None
+    return out
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    events = []
+    base = None
+    for khz, dropped, dump in read_dumps(data):
+        if dropped:
+            sys.stderr.write("%d events lost to the ring wrapping\n" % dropped)
+        if khz == 0:
+            sys.exit("dump has no tsc rate")
+        for event in dump:
+            if event[1] == TR_NONE:
+                continue
+            if base is None:
+                base = event[0]
+            out = convert(event, base, khz)
+            if out is not None:
+                events.append(out)
+
+    names = {tid: "pid %d" % tid for tid in {e["tid"] for e in events}}
+    names[IRQ_TID] = "irq"
+    names[KERNEL_TID] = "kernel"
+    meta = [{"ph": "M", "pid": 0, "tid": tid, "name": "thread_name",
+             "args": {"name": name}} for tid, name in sorted(names.items())]
+
+    trace = json.dumps({"traceEvents": meta + events,
+                        "displayTimeUnit": "ns"}, indent=1)
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "w") as f:
+            f.write(trace)
+    else:
+        print(trace)
+
+
+if __name__ == "__main__":
+    main()